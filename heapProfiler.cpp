@@ -0,0 +1,139 @@
+#include "heapProfiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <ostream>
+#include <random>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <execinfo.h>
+#endif
+
+SamplingProfiler::SamplingProfiler()
+    : rng(std::random_device()())
+{
+    sampleInterval = 512 * 1024;
+    bytesUntilSample = nextSampleDistance();
+}
+
+void SamplingProfiler::setSampleInterval(std::size_t interval)
+{
+    sampleInterval = interval ? interval : 1;
+    bytesUntilSample = nextSampleDistance();
+}
+
+std::size_t SamplingProfiler::nextSampleDistance()
+{
+    if (sampleInterval == 1)
+    {
+        return 0;
+    }
+    std::exponential_distribution<double> distance(1.0 / sampleInterval);
+    return static_cast<std::size_t>(distance(rng));
+}
+
+void SamplingProfiler::recordSample(void* ptr, std::size_t size, void* caller)
+{
+    Sample& sample = samples[ptr];
+    sample.size = size;
+    sample.depth = captureStack(sample.frames, maxFrames, caller);
+}
+
+void SamplingProfiler::dropSample(void* ptr)
+{
+    samples.erase(ptr);
+}
+
+std::vector<SamplingProfiler::Site> SamplingProfiler::getProfile()
+{
+    std::map<std::vector<void*>, Site> sites;
+    for (const auto& [ptr, sample] : samples)
+    {
+        std::vector<void*> frames(sample.frames, sample.frames + sample.depth);
+        Site& site = sites[frames];
+        site.frames = frames;
+        site.samples++;
+        site.sampledBytes += sample.size;
+        // A block of size bytes gets sampled with probability 1 - e^(-size/interval), so each
+        // sample stands for size / that many bytes.
+        double probability = 1.0 - std::exp(-static_cast<double>(sample.size) / sampleInterval);
+        site.estimatedBytes += sample.size / probability;
+    }
+
+    std::vector<Site> profile;
+    for (auto& [frames, site] : sites)
+    {
+        profile.push_back(site);
+    }
+    std::sort(profile.begin(), profile.end(), [](const Site& a, const Site& b) {
+        return a.estimatedBytes > b.estimatedBytes;
+    });
+    return profile;
+}
+
+void SamplingProfiler::dump(std::ostream& out)
+{
+    std::vector<Site> profile = getProfile();
+    double total = 0;
+    for (const Site& site : profile)
+    {
+        total += site.estimatedBytes;
+    }
+    out << "Heap profile: about " << static_cast<std::size_t>(total) << " live bytes in "
+        << profile.size() << " call sites (sample interval " << sampleInterval << " bytes)\n";
+
+    for (const Site& site : profile)
+    {
+        out << static_cast<std::size_t>(site.estimatedBytes) << " bytes (" << site.samples
+            << " samples, " << site.sampledBytes << " bytes sampled)\n";
+#ifdef _WIN32
+        for (void* frame : site.frames)
+        {
+            out << "\t" << frame << "\n";
+        }
+#else
+        char** symbols = backtrace_symbols(site.frames.data(), static_cast<int>(site.frames.size()));
+        for (std::size_t i = 0; i < site.frames.size(); i++)
+        {
+            if (symbols)
+            {
+                out << "\t" << symbols[i] << "\n";
+            }
+            else
+            {
+                out << "\t" << site.frames[i] << "\n";
+            }
+        }
+        std::free(symbols);
+#endif
+    }
+}
+
+std::size_t SamplingProfiler::captureStack(void** frames, std::size_t maxDepth, void* caller)
+{
+    // How many of the allocator's frames (this function, recordSample, profileMalloc and the
+    // entry point) we allow for above the call site. Inlining can make it fewer.
+    const std::size_t allocatorFrames = 4;
+
+    void* all[maxFrames + allocatorFrames];
+#ifdef _WIN32
+    std::size_t depth = CaptureStackBackTrace(0, static_cast<DWORD>(maxDepth + allocatorFrames), all, NULL);
+#else
+    int captured = backtrace(all, static_cast<int>(maxDepth + allocatorFrames));
+    std::size_t depth = captured > 0 ? captured : 0;
+#endif
+
+    // The call site's frame is the one whose return address is caller. If it isn't there, fall
+    // back to skipping just this function and recordSample.
+    std::size_t start = std::find(all, all + depth, caller) - all;
+    if (start == depth)
+    {
+        start = depth < 2 ? depth : 2;
+    }
+    std::size_t kept = depth - start < maxDepth ? depth - start : maxDepth;
+    std::copy(all + start, all + start + kept, frames);
+    return kept;
+}
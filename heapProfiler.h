@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <iosfwd>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+// A profiler policy that samples allocations by bytes allocated, like tcmalloc's heap profiler.
+// The distance (in bytes) between samples is drawn from an exponential distribution whose mean
+// is the sample interval, so every byte is equally likely to be sampled and allocation patterns
+// can't line up with the sampling. A sampled allocation records a stack trace, which is dropped
+// again when the block is freed. Between samples, the only cost of malloc is a subtraction and
+// a comparison, so it's cheap enough to leave on with a sparse interval.
+class SamplingProfiler
+{
+public:
+    static constexpr bool enabled = true;
+    static const std::size_t maxFrames = 32;
+
+    // The default interval, 512 KiB, is tcmalloc's. Each profiler is seeded differently, so
+    // processes running the same code don't all sample the same allocations.
+    SamplingProfiler();
+
+    // A mean of interval bytes between samples. An interval of 1 samples every allocation.
+    void setSampleInterval(std::size_t interval);
+
+    // The profiler policy interface, which Schurmalloc calls under its lock
+    bool shouldSample(std::size_t size)
+    {
+        if (size < bytesUntilSample)
+        {
+            bytesUntilSample -= size;
+            return false;
+        }
+        bytesUntilSample = nextSampleDistance();
+        return true;
+    }
+    void recordSample(void* ptr, std::size_t size, void* caller);
+    void dropSample(void* ptr);
+
+    // Live sampled allocations with the same stack trace, aggregated.
+    // samples: How many sampled allocations are live.
+    // sampledBytes: Their total size.
+    // estimatedBytes: An unbiased estimate of the live bytes allocated from this call site,
+    //   sampled or not.
+    struct Site
+    {
+        std::vector<void*> frames;
+        std::size_t samples;
+        std::size_t sampledBytes;
+        double estimatedBytes;
+    };
+
+    // The live heap profile, with the call sites owning the most memory first.
+    std::vector<Site> getProfile();
+
+    // Writes the live heap profile as text, one call site per paragraph.
+    void dump(std::ostream& out);
+
+private:
+    struct Sample
+    {
+        std::size_t size;
+        std::size_t depth;
+        void* frames[maxFrames];
+    };
+
+    std::size_t sampleInterval;
+    std::size_t bytesUntilSample;
+    std::minstd_rand rng;
+    std::unordered_map<void*, Sample> samples;
+
+    std::size_t nextSampleDistance();
+
+    // Captures the current stack into frames, starting at caller's frame, so that the allocator's
+    // own frames are left out. (If the heap's entry point was inlined into its caller, that's the
+    // caller's caller.) Returns the number of frames captured.
+    static std::size_t captureStack(void** frames, std::size_t maxDepth, void* caller);
+};
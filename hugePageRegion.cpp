@@ -0,0 +1,136 @@
+#include "hugePageRegion.h"
+#include <cstdint>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#ifdef _WIN32
+
+HugePageRegion::HugePageRegion(std::size_t size, Mode mode)
+{
+    this->size = (size + hugePageSize - 1) / hugePageSize * hugePageSize;
+    this->mode = Mode::None;
+    memory = NULL;
+
+    // Windows has no transparent huge pages, so both Transparent and Explicit try large pages,
+    // which need SeLockMemoryPrivilege and a size that's a multiple of the large page size.
+    if (mode != Mode::None)
+    {
+        SIZE_T largePage = GetLargePageMinimum();
+        if (largePage && this->size % largePage == 0)
+        {
+            memory = VirtualAlloc(NULL, this->size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (memory)
+            {
+                this->mode = Mode::Explicit;
+                return;
+            }
+        }
+    }
+    // Regular pages are only 64 KiB-aligned, so reserve a huge page more than we need, find the
+    // huge page boundary in it, and map again right there. Another thread can grab the address in
+    // between, so try a few times.
+    for (int attempt = 0; attempt < 8 && memory == NULL; attempt++)
+    {
+        void* padded = VirtualAlloc(NULL, this->size + hugePageSize, MEM_RESERVE, PAGE_NOACCESS);
+        if (padded == NULL)
+        {
+            return;
+        }
+        std::uintptr_t aligned = (reinterpret_cast<std::uintptr_t>(padded) + hugePageSize - 1) / hugePageSize * hugePageSize;
+        VirtualFree(padded, 0, MEM_RELEASE);
+        memory = VirtualAlloc(reinterpret_cast<void*>(aligned), this->size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    }
+}
+
+HugePageRegion::~HugePageRegion()
+{
+    if (memory)
+    {
+        VirtualFree(memory, 0, MEM_RELEASE);
+    }
+}
+
+#else
+
+HugePageRegion::HugePageRegion(std::size_t size, Mode mode)
+{
+    this->size = (size + hugePageSize - 1) / hugePageSize * hugePageSize;
+    this->mode = Mode::None;
+    memory = NULL;
+
+#ifdef MAP_HUGETLB
+    if (mode == Mode::Explicit)
+    {
+        void* mapping = mmap(NULL, this->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mapping != MAP_FAILED)
+        {
+            memory = mapping;
+            this->mode = Mode::Explicit;
+            return;
+        }
+        // The hugetlbfs pool is empty (or not set up), so settle for transparent huge pages.
+        mode = Mode::Transparent;
+    }
+#endif
+
+    // Over-map by a huge page, then trim, so that the region starts on a huge page boundary.
+    // Otherwise the kernel can't back its first and last partial huge pages with huge pages.
+    std::size_t padded = this->size + hugePageSize;
+    void* mapping = mmap(NULL, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        return;
+    }
+    std::uintptr_t start = reinterpret_cast<std::uintptr_t>(mapping);
+    std::uintptr_t aligned = (start + hugePageSize - 1) / hugePageSize * hugePageSize;
+    if (aligned > start)
+    {
+        munmap(mapping, aligned - start);
+    }
+    std::uintptr_t end = start + padded;
+    if (end > aligned + this->size)
+    {
+        munmap(reinterpret_cast<void*>(aligned + this->size), end - (aligned + this->size));
+    }
+    memory = reinterpret_cast<void*>(aligned);
+
+#if defined(MADV_HUGEPAGE) && defined(MADV_NOHUGEPAGE)
+    if (mode == Mode::None)
+    {
+        madvise(memory, this->size, MADV_NOHUGEPAGE);
+    }
+    else if (madvise(memory, this->size, MADV_HUGEPAGE) == 0)
+    {
+        this->mode = Mode::Transparent;
+    }
+#endif
+}
+
+HugePageRegion::~HugePageRegion()
+{
+    if (memory)
+    {
+        munmap(memory, size);
+    }
+}
+
+#endif
+
+void* HugePageRegion::getMemory()
+{
+    return memory;
+}
+
+std::size_t HugePageRegion::getSize()
+{
+    return size;
+}
+
+HugePageRegion::Mode HugePageRegion::getMode()
+{
+    return mode;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+
+// A block of memory for a Schurmalloc heap, mapped straight from the OS and backed by huge pages
+// where possible. With 2 MiB pages instead of 4 KiB ones, a heap of tens of GB needs far fewer
+// TLB entries, so payload accesses miss the TLB much less often.
+class HugePageRegion
+{
+public:
+    static const std::size_t hugePageSize = 2 * 1024 * 1024;
+
+    // None: Regular pages. (On Linux, transparent huge pages are explicitly turned off, which
+    //   makes for a fair baseline.)
+    // Transparent: Memory that the kernel is asked to back with transparent huge pages
+    //   (MADV_HUGEPAGE). Windows has none, so there it's the same as Explicit.
+    // Explicit: Memory from the hugetlbfs pool (MAP_HUGETLB), or large pages on Windows. Falls
+    //   back to Transparent on Linux, and to regular pages on Windows.
+    // Whatever the mode, the memory is 2 MiB-aligned.
+    enum class Mode { None, Transparent, Explicit };
+
+    HugePageRegion() = delete;
+    HugePageRegion(const HugePageRegion&) = delete;
+    HugePageRegion& operator=(const HugePageRegion&) = delete;
+
+    // Maps size bytes, rounded up to a whole number of huge pages.
+    HugePageRegion(std::size_t size, Mode mode);
+    ~HugePageRegion();
+
+    // The mapped memory, or NULL if it couldn't be mapped.
+    void* getMemory();
+    std::size_t getSize();
+
+    // What we actually got, which can be less than what was asked for.
+    Mode getMode();
+
+private:
+    void* memory;
+    std::size_t size;
+    Mode mode;
+};
@@ -0,0 +1,296 @@
+#pragma once
+#include "schurmalloc.h"
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+// How long a block is expected to live.
+// Short: Freed soon, e.g. a buffer for one request.
+// Long: Lives a while, but is freed eventually, e.g. a cache entry.
+// Permanent: Never freed, or only at shutdown.
+// Auto: Let the heap predict Short or Long from what it's seen of blocks of about the same size.
+enum class Lifetime { Short, Long, Permanent, Auto };
+
+// Splits a block of memory into a sub-region (each its own Schurmalloc) per lifetime class, so
+// long-lived blocks can't pin fragments between short-lived ones, and the short-lived sub-region
+// keeps coalescing back into large blocks. If a block's sub-region is full, it spills over into
+// the others rather than failing. free finds a block's sub-region by comparing its address with
+// the sub-region boundaries. A sub-region too small to hold a block (e.g. Permanent, if the Short
+// and Long shares add up to 1) gets no Schurmalloc, and its blocks always spill.
+//
+// With Lifetime::Auto, lifetimes are predicted per size class (sizes with the same bit width).
+// Every so many Auto allocations, one is sampled, and it votes Short if it's freed within the
+// short lifetime (counted in Auto allocations), and Long otherwise. A size class goes to the Long
+// sub-region once its Long votes outnumber its Short votes.
+template <class Policies = DefaultPolicies>
+class BasicLifetimeHeap
+{
+public:
+    BasicLifetimeHeap() = delete;
+    BasicLifetimeHeap(const BasicLifetimeHeap&) = delete;
+    BasicLifetimeHeap& operator=(const BasicLifetimeHeap&) = delete;
+
+    // mem, size: The block of memory to split up.
+    // shortShare, longShare: The fractions of it for the Short and Long sub-regions. The
+    //   Permanent sub-region gets the rest. Neither can be negative, and they can add up to at
+    //   most 1.
+    BasicLifetimeHeap(void* mem, std::size_t size, double shortShare, double longShare);
+
+    void* malloc(std::size_t size, Lifetime lifetime);
+    void free(void* ptr);
+
+    // Which sub-region ptr is in. (Not necessarily the lifetime it was allocated with, if it spilled.)
+    Lifetime getLifetime(void* ptr);
+
+    // The Schurmalloc serving a sub-region, e.g. for its stats or free space. lifetime can't be Auto.
+    // Returns NULL if the sub-region is too small to have one.
+    BasicSchurmalloc<Policies>* getHeap(Lifetime lifetime);
+
+    // How much of the memory has ever been used: the sum over sub-regions of how far into the
+    // sub-region the highest allocated byte has been.
+    std::size_t getPeakFootprint();
+
+    // Configures Auto. shortLifetime: A sampled block freed within this many Auto allocations
+    // votes Short. sampleInterval: One in this many Auto allocations is sampled. The defaults are
+    // 1000 and 64.
+    void setPrediction(std::size_t shortLifetime, std::size_t sampleInterval);
+
+private:
+    static const std::size_t classes = 3;
+    static const std::size_t sizeClasses = 65;
+
+    // Where to look next when a sub-region is full, in order
+    static constexpr std::size_t spill[classes][classes] = {{0, 1, 2}, {1, 2, 0}, {2, 1, 0}};
+
+    // Sub-region i is [bounds[i], bounds[i + 1]).
+    char* bounds[classes + 1];
+    // Empty for a sub-region too small to hold a block
+    std::optional<BasicSchurmalloc<Policies>> heaps[classes];
+    std::size_t highWater[classes];
+
+    // birth: The allocation clock when the block was allocated.
+    // sizeClass: The size class it votes for.
+    struct Sample
+    {
+        std::size_t birth;
+        std::size_t sizeClass;
+    };
+
+    // Votes decay (both are halved) once there are this many, so predictions follow phase changes.
+    static const std::uint32_t maxVotes = 64;
+    struct Votes
+    {
+        std::uint32_t shortVotes;
+        std::uint32_t longVotes;
+    };
+
+    std::size_t shortLifetime;
+    std::size_t sampleInterval;
+    // Counts Auto allocations
+    std::size_t clock;
+    // The clock at the last sweep of samples
+    std::size_t lastSweep;
+    std::unordered_map<void*, Sample> samples;
+    Votes votes[sizeClasses];
+
+    typename Policies::Lock lock;
+
+    // Where in a block of size bytes to split it so the first part is share of it. Keeps
+    // sub-regions max-aligned. share must be in [0, 1].
+    static std::size_t splitPoint(std::size_t size, double share);
+
+    // Which sub-region ptr is in
+    std::size_t owner(void* ptr);
+
+    // Predicts Short or Long for an Auto allocation of size bytes. Returns the sub-region to use,
+    // and sets sample if this allocation should be sampled.
+    std::size_t predict(std::size_t size, bool& sample);
+    void vote(std::size_t sizeClass, bool isShort);
+
+    // Samples older than shortLifetime vote Long.
+    void sweep();
+};
+
+using LifetimeHeap = BasicLifetimeHeap<>;
+
+template <class Policies>
+BasicLifetimeHeap<Policies>::BasicLifetimeHeap(void* mem, std::size_t size, double shortShare, double longShare)
+    : bounds{static_cast<char*>(mem),
+             static_cast<char*>(mem) + splitPoint(size, shortShare),
+             static_cast<char*>(mem) + splitPoint(size, shortShare + longShare),
+             static_cast<char*>(mem) + size}
+{
+    assert(shortShare >= 0 && longShare >= 0 && shortShare + longShare <= 1);
+    for (std::size_t i = 0; i < classes; i++)
+    {
+        std::size_t regionSize = bounds[i + 1] - bounds[i];
+        if (regionSize >= BasicSchurmalloc<Policies>::getMinSize())
+        {
+            heaps[i].emplace(bounds[i], regionSize);
+        }
+        highWater[i] = 0;
+    }
+    for (std::size_t i = 0; i < sizeClasses; i++)
+    {
+        votes[i] = {0, 0};
+    }
+    shortLifetime = 1000;
+    sampleInterval = 64;
+    clock = 0;
+    lastSweep = 0;
+}
+
+template <class Policies>
+std::size_t BasicLifetimeHeap<Policies>::splitPoint(std::size_t size, double share)
+{
+    assert(share >= 0 && share <= 1);
+    std::size_t point = static_cast<std::size_t>(size * share);
+    point -= point % alignof(std::max_align_t);
+    return point < size ? point : size;
+}
+
+template <class Policies>
+std::size_t BasicLifetimeHeap<Policies>::owner(void* ptr)
+{
+    char* p = static_cast<char*>(ptr);
+    assert(p >= bounds[0] && p < bounds[classes]);
+    return p < bounds[1] ? 0 : p < bounds[2] ? 1 : 2;
+}
+
+template <class Policies>
+void* BasicLifetimeHeap<Policies>::malloc(std::size_t size, Lifetime lifetime)
+{
+    std::size_t preferred;
+    bool sample = false;
+    if (lifetime == Lifetime::Auto)
+    {
+        std::lock_guard<typename Policies::Lock> guard(lock);
+        preferred = predict(size, sample);
+    }
+    else
+    {
+        preferred = static_cast<std::size_t>(lifetime);
+    }
+
+    for (std::size_t i : spill[preferred])
+    {
+        if (!heaps[i])
+        {
+            continue;
+        }
+        void* ptr = heaps[i]->malloc(size);
+        if (ptr)
+        {
+            std::size_t end = static_cast<char*>(ptr) + size - bounds[i];
+            std::lock_guard<typename Policies::Lock> guard(lock);
+            if (end > highWater[i])
+            {
+                highWater[i] = end;
+            }
+            if (sample)
+            {
+                samples[ptr] = {clock, static_cast<std::size_t>(std::bit_width(size))};
+            }
+            return ptr;
+        }
+    }
+    return NULL;
+}
+
+template <class Policies>
+void BasicLifetimeHeap<Policies>::free(void* ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+    {
+        std::lock_guard<typename Policies::Lock> guard(lock);
+        if (!samples.empty())
+        {
+            auto sample = samples.find(ptr);
+            if (sample != samples.end())
+            {
+                vote(sample->second.sizeClass, clock - sample->second.birth <= shortLifetime);
+                samples.erase(sample);
+            }
+        }
+    }
+    heaps[owner(ptr)]->free(ptr);
+}
+
+template <class Policies>
+Lifetime BasicLifetimeHeap<Policies>::getLifetime(void* ptr)
+{
+    return static_cast<Lifetime>(owner(ptr));
+}
+
+template <class Policies>
+BasicSchurmalloc<Policies>* BasicLifetimeHeap<Policies>::getHeap(Lifetime lifetime)
+{
+    assert(lifetime != Lifetime::Auto);
+    std::optional<BasicSchurmalloc<Policies>>& heap = heaps[static_cast<std::size_t>(lifetime)];
+    return heap ? &*heap : NULL;
+}
+
+template <class Policies>
+std::size_t BasicLifetimeHeap<Policies>::getPeakFootprint()
+{
+    std::lock_guard<typename Policies::Lock> guard(lock);
+    return highWater[0] + highWater[1] + highWater[2];
+}
+
+template <class Policies>
+void BasicLifetimeHeap<Policies>::setPrediction(std::size_t shortLifetime, std::size_t sampleInterval)
+{
+    std::lock_guard<typename Policies::Lock> guard(lock);
+    this->shortLifetime = shortLifetime;
+    this->sampleInterval = sampleInterval ? sampleInterval : 1;
+}
+
+template <class Policies>
+std::size_t BasicLifetimeHeap<Policies>::predict(std::size_t size, bool& sample)
+{
+    clock++;
+    if (clock - lastSweep > shortLifetime)
+    {
+        sweep();
+    }
+    sample = clock % sampleInterval == 0;
+    const Votes& v = votes[std::bit_width(size)];
+    return v.longVotes > v.shortVotes ? static_cast<std::size_t>(Lifetime::Long) : static_cast<std::size_t>(Lifetime::Short);
+}
+
+template <class Policies>
+void BasicLifetimeHeap<Policies>::vote(std::size_t sizeClass, bool isShort)
+{
+    Votes& v = votes[sizeClass];
+    (isShort ? v.shortVotes : v.longVotes)++;
+    if (v.shortVotes + v.longVotes >= maxVotes)
+    {
+        v.shortVotes /= 2;
+        v.longVotes /= 2;
+    }
+}
+
+template <class Policies>
+void BasicLifetimeHeap<Policies>::sweep()
+{
+    lastSweep = clock;
+    for (auto sample = samples.begin(); sample != samples.end();)
+    {
+        if (clock - sample->second.birth > shortLifetime)
+        {
+            vote(sample->second.sizeClass, false);
+            sample = samples.erase(sample);
+        }
+        else
+        {
+            ++sample;
+        }
+    }
+}
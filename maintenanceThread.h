@@ -0,0 +1,204 @@
+#pragma once
+#include "schurmalloc.h"
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Moves the housekeeping in free (free list insertion and coalescing) off the caller's thread.
+// free only puts the pointer on a bounded queue, and a background thread hands queued pointers
+// to the heap in batches. The worker is only woken once a whole batch is waiting, so free doesn't
+// pay for a wakeup each time. If the queue is full because the worker has fallen behind, free
+// falls back to freeing synchronously.
+//
+// Memory that's queued isn't reusable until the worker gets to it, so malloc and realloc flush
+// the queue and try again before giving up.
+template <class Policies = DefaultPolicies>
+class BasicMaintenanceThread
+{
+    static_assert(!std::is_same_v<typename Policies::Lock, NoLock>,
+                  "The heap is shared with the worker thread, so it needs a real lock policy");
+
+public:
+    BasicMaintenanceThread() = delete;
+    BasicMaintenanceThread(const BasicMaintenanceThread&) = delete;
+    BasicMaintenanceThread& operator=(const BasicMaintenanceThread&) = delete;
+
+    // queueCapacity: How many frees can be waiting before free falls back to freeing synchronously.
+    // batchSize: How many frees the worker hands to the heap per lock acquisition.
+    BasicMaintenanceThread(BasicSchurmalloc<Policies>& heap, std::size_t queueCapacity, std::size_t batchSize);
+
+    // Finishes the queued frees, then stops the worker.
+    ~BasicMaintenanceThread();
+
+    void* malloc(std::size_t size);
+    void* realloc(void* ptr, std::size_t newSize);
+    void free(void* ptr);
+
+    // Blocks until every queued free has been handed to the heap, including a partial batch.
+    void flush();
+
+    // How many frees had to be done synchronously because the queue was full.
+    std::size_t getSynchronousFrees();
+
+private:
+    BasicSchurmalloc<Policies>& heap;
+    std::size_t batchSize;
+
+    // A ring buffer of pointers waiting to be freed. queueHead is the oldest.
+    std::vector<void*> queue;
+    std::size_t queueHead;
+    std::size_t queueCount;
+
+    // How many pointers the worker has taken off the queue but not freed yet.
+    std::size_t inFlight;
+    std::size_t synchronousFrees;
+    bool stopping;
+
+    std::mutex queueMutex;
+    std::condition_variable workAvailable;
+    std::condition_variable drained;
+    std::thread worker;
+
+    void work();
+};
+
+using MaintenanceThread = BasicMaintenanceThread<>;
+
+template <class Policies>
+BasicMaintenanceThread<Policies>::BasicMaintenanceThread(BasicSchurmalloc<Policies>& heap,
+                                                         std::size_t queueCapacity,
+                                                         std::size_t batchSize)
+    : heap(heap), batchSize(batchSize), queue(queueCapacity)
+{
+    assert(queueCapacity > 0);
+    assert(batchSize > 0);
+    queueHead = 0;
+    queueCount = 0;
+    inFlight = 0;
+    synchronousFrees = 0;
+    stopping = false;
+    worker = std::thread(&BasicMaintenanceThread::work, this);
+}
+
+template <class Policies>
+BasicMaintenanceThread<Policies>::~BasicMaintenanceThread()
+{
+    {
+        std::lock_guard<std::mutex> guard(queueMutex);
+        stopping = true;
+    }
+    workAvailable.notify_one();
+    worker.join();
+}
+
+template <class Policies>
+void* BasicMaintenanceThread<Policies>::malloc(std::size_t size)
+{
+    void* ptr = heap.malloc(size);
+    if (ptr == NULL)
+    {
+        // Maybe the space we need is sitting in the queue
+        flush();
+        ptr = heap.malloc(size);
+    }
+    return ptr;
+}
+
+template <class Policies>
+void* BasicMaintenanceThread<Policies>::realloc(void* ptr, std::size_t newSize)
+{
+    void* newPtr = heap.realloc(ptr, newSize);
+    if (newPtr == NULL && newSize != 0)
+    {
+        flush();
+        newPtr = heap.realloc(ptr, newSize);
+    }
+    return newPtr;
+}
+
+template <class Policies>
+void BasicMaintenanceThread<Policies>::free(void* ptr)
+{
+    bool fullBatch = false;
+    {
+        std::lock_guard<std::mutex> guard(queueMutex);
+        if (queueCount < queue.size())
+        {
+            queue[(queueHead + queueCount) % queue.size()] = ptr;
+            queueCount++;
+            ptr = NULL;
+            // Wake the worker once per batch (or once the queue is full, if it's smaller than a batch)
+            fullBatch = queueCount == batchSize || queueCount == queue.size();
+        }
+        else
+        {
+            synchronousFrees++;
+        }
+    }
+
+    if (ptr)
+    {
+        // The worker has fallen behind, so do it ourselves
+        heap.free(ptr);
+    }
+    else if (fullBatch)
+    {
+        workAvailable.notify_one();
+    }
+}
+
+template <class Policies>
+void BasicMaintenanceThread<Policies>::flush()
+{
+    std::unique_lock<std::mutex> guard(queueMutex);
+    // The worker may be asleep on less than a batch.
+    workAvailable.notify_one();
+    drained.wait(guard, [this] { return queueCount == 0 && inFlight == 0; });
+}
+
+template <class Policies>
+std::size_t BasicMaintenanceThread<Policies>::getSynchronousFrees()
+{
+    std::lock_guard<std::mutex> guard(queueMutex);
+    return synchronousFrees;
+}
+
+template <class Policies>
+void BasicMaintenanceThread<Policies>::work()
+{
+    std::vector<void*> batch(batchSize);
+    std::unique_lock<std::mutex> guard(queueMutex);
+    for (;;)
+    {
+        workAvailable.wait(guard, [this] { return stopping || queueCount > 0; });
+        if (queueCount == 0)
+        {
+            // stopping, and there's nothing left to do
+            return;
+        }
+
+        std::size_t taken = queueCount < batchSize ? queueCount : batchSize;
+        for (std::size_t i = 0; i < taken; i++)
+        {
+            batch[i] = queue[(queueHead + i) % queue.size()];
+        }
+        queueHead = (queueHead + taken) % queue.size();
+        queueCount -= taken;
+        inFlight += taken;
+
+        // Don't hold up free while the heap does the real work
+        guard.unlock();
+        heap.freeBatch(batch.data(), taken);
+        guard.lock();
+
+        inFlight -= taken;
+        if (queueCount == 0 && inFlight == 0)
+        {
+            drained.notify_all();
+        }
+    }
+}
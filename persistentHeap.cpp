@@ -0,0 +1,172 @@
+#include "persistentHeap.h"
+#include <cstddef>
+#include <cassert>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const char* path, std::size_t size)
+{
+    mapping = NULL;
+    mappingSize = 0;
+
+    if (openFile(path, size))
+    {
+        mapping = map(NULL);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (mapping)
+    {
+        unmap();
+    }
+    closeFile();
+}
+
+void* MappedFile::getMemory()
+{
+    return mapping;
+}
+
+std::size_t MappedFile::getSize()
+{
+    return mappingSize;
+}
+
+bool MappedFile::remap(void* address)
+{
+    if (mapping)
+    {
+        unmap();
+    }
+    mapping = map(address);
+    return mapping == address;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::openFile(const char* path, std::size_t size)
+{
+    fileMapping = NULL;
+    file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        file = NULL;
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+        return false;
+    }
+
+    // CreateFileMapping grows a new file to size for us.
+    mappingSize = fileSize.QuadPart ? static_cast<std::size_t>(fileSize.QuadPart) : size;
+    fileMapping = CreateFileMappingA(file, NULL, PAGE_READWRITE,
+                                     static_cast<DWORD>(static_cast<unsigned long long>(mappingSize) >> 32),
+                                     static_cast<DWORD>(mappingSize), NULL);
+    return fileMapping != NULL;
+}
+
+void MappedFile::closeFile()
+{
+    if (fileMapping)
+    {
+        CloseHandle(fileMapping);
+    }
+    if (file)
+    {
+        CloseHandle(file);
+    }
+}
+
+void MappedFile::sync()
+{
+    assert(mapping);
+    FlushViewOfFile(mapping, mappingSize);
+    FlushFileBuffers(file);
+}
+
+void* MappedFile::map(void* address)
+{
+    void* result = MapViewOfFileEx(fileMapping, FILE_MAP_ALL_ACCESS, 0, 0, mappingSize, address);
+    if (result == NULL && address)
+    {
+        result = MapViewOfFileEx(fileMapping, FILE_MAP_ALL_ACCESS, 0, 0, mappingSize, NULL);
+    }
+    return result;
+}
+
+void MappedFile::unmap()
+{
+    UnmapViewOfFile(mapping);
+    mapping = NULL;
+}
+
+#else
+
+bool MappedFile::openFile(const char* path, std::size_t size)
+{
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        return false;
+    }
+    if (st.st_size == 0)
+    {
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+        {
+            return false;
+        }
+        mappingSize = size;
+    }
+    else
+    {
+        mappingSize = static_cast<std::size_t>(st.st_size);
+    }
+    return true;
+}
+
+void MappedFile::closeFile()
+{
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+void MappedFile::sync()
+{
+    assert(mapping);
+    msync(mapping, mappingSize, MS_SYNC);
+}
+
+void* MappedFile::map(void* address)
+{
+    // Without MAP_FIXED, address is only a hint. The kernel picks another address if it's taken.
+    void* result = mmap(address, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return result == MAP_FAILED ? NULL : result;
+}
+
+void MappedFile::unmap()
+{
+    munmap(mapping, mappingSize);
+    mapping = NULL;
+}
+
+#endif
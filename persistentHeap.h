@@ -0,0 +1,127 @@
+#pragma once
+#include "schurmalloc.h"
+#include <cstddef>
+#include <iostream>
+#include <optional>
+
+// A file mapped read-write into memory. Changes to the memory are written back to the file.
+class MappedFile
+{
+public:
+    MappedFile() = delete;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Opens and maps the file at path. If the file doesn't exist (or is empty), it's created with
+    // size bytes. Otherwise the file keeps its own size, and size is ignored.
+    MappedFile(const char* path, std::size_t size);
+
+    // Unmaps and closes the file.
+    ~MappedFile();
+
+    // The mapped file, or NULL if it couldn't be opened or mapped.
+    void* getMemory();
+    std::size_t getSize();
+
+    // Moves the mapping to address, if that address is free. Returns whether it's there now.
+    // (If the mapping can't be put back anywhere, getMemory() returns NULL afterwards.)
+    bool remap(void* address);
+
+    // Flushes the mapped memory to the file.
+    void sync();
+
+private:
+    void* mapping;
+    std::size_t mappingSize;
+
+#ifdef _WIN32
+    void* file;
+    void* fileMapping;
+#else
+    int fd;
+#endif
+
+    // Opens (or creates) the file and sets mappingSize. Returns false on failure.
+    bool openFile(const char* path, std::size_t size);
+    void closeFile();
+
+    // Maps the file at the given address if possible, or anywhere if address is NULL or taken.
+    // Returns NULL on failure.
+    void* map(void* address);
+    void unmap();
+};
+
+// Runs a persistent Schurmalloc on a memory-mapped file, so that the heap (and whatever the user
+// keeps reachable from its root object) survives restarts. Reopening the heap only needs to map
+// the file again; the heap isn't reformatted.
+template <class Policies = DefaultPolicies>
+class BasicPersistentHeap
+{
+    static_assert(!Policies::Prefault::dirties,
+                  "Prefaulting for writes dirties the heap file ahead of the frontier; prefault for reads instead");
+
+public:
+    BasicPersistentHeap() = delete;
+    BasicPersistentHeap(const BasicPersistentHeap&) = delete;
+    BasicPersistentHeap& operator=(const BasicPersistentHeap&) = delete;
+
+    // Opens the heap file at path. If the file doesn't exist (or is empty), it's created with size
+    // bytes. Otherwise the file keeps its own size, and size is ignored.
+    BasicPersistentHeap(const char* path, std::size_t size)
+        : file(path, size)
+    {
+        if (file.getMemory() == NULL)
+        {
+            return;
+        }
+
+        // Try to put the heap back where it was last time, so that Schurmalloc doesn't need to
+        // relocate the free list, and pointers stored in the heap stay valid.
+        void* preferred = BasicSchurmalloc<Policies>::getPreferredAddress(file.getMemory(), file.getSize());
+        if (preferred && preferred != file.getMemory() && !file.remap(preferred))
+        {
+            if constexpr (Policies::trace)
+            {
+                std::cout << "PersistentHeap: Couldn't map the heap at its old address. It will be relocated.\n";
+            }
+            if (file.getMemory() == NULL)
+            {
+                return;
+            }
+        }
+
+        schurm.emplace(file.getMemory(), file.getSize(), BasicSchurmalloc<Policies>::Persistence::Persistent);
+
+        // Get the heap's dirty flag onto disk, so that an OS crash also leads to recovery.
+        file.sync();
+    }
+
+    // Shuts the heap down cleanly and flushes it to the file.
+    ~BasicPersistentHeap()
+    {
+        if (schurm)
+        {
+            schurm->shutdown();
+            file.sync();
+        }
+    }
+
+    // The heap living in the file, or NULL if the file couldn't be opened or mapped.
+    BasicSchurmalloc<Policies>* heap()
+    {
+        return schurm ? &*schurm : NULL;
+    }
+
+    // Flushes the mapped heap to the file.
+    void sync()
+    {
+        file.sync();
+    }
+
+private:
+    // Declared first, so that the file outlives the heap living in it.
+    MappedFile file;
+    std::optional<BasicSchurmalloc<Policies>> schurm;
+};
+
+using PersistentHeap = BasicPersistentHeap<>;
@@ -0,0 +1,125 @@
+#include "prefaulter.h"
+#include <cstdint>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+Prefaulter::Prefaulter(void* mem, std::size_t size, std::size_t lookahead, Access access)
+    : memory(static_cast<char*>(mem)), size(size), lookahead(lookahead), access(access), frontier(0), populated(0)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    pageSize = info.dwPageSize;
+#else
+    pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+    stopping = false;
+    worker = std::thread(&Prefaulter::work, this);
+}
+
+Prefaulter::~Prefaulter()
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopping = true;
+    }
+    workAvailable.notify_one();
+    worker.join();
+}
+
+std::size_t Prefaulter::target()
+{
+    std::size_t end = frontier.load(std::memory_order_relaxed) + lookahead;
+    return end < size ? end : size;
+}
+
+void Prefaulter::advance(void* end)
+{
+    std::size_t offset = static_cast<char*>(end) - memory;
+    std::size_t current = frontier.load(std::memory_order_relaxed);
+    while (offset > current && !frontier.compare_exchange_weak(current, offset, std::memory_order_relaxed))
+    {
+    }
+
+    // Only wake the worker once it's fallen a quarter of the lookahead behind, so it works in
+    // batches instead of a page at a time.
+    if (target() >= populated.load(std::memory_order_relaxed) + lookahead / 4 + pageSize)
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        workAvailable.notify_one();
+    }
+}
+
+void Prefaulter::wait()
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    workAvailable.notify_one();
+    caughtUp.wait(guard, [this] { return populated.load(std::memory_order_relaxed) >= target(); });
+}
+
+std::size_t Prefaulter::getPopulated()
+{
+    return populated.load(std::memory_order_relaxed);
+}
+
+void Prefaulter::work()
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    for (;;)
+    {
+        workAvailable.wait(guard, [this] { return stopping || populated.load(std::memory_order_relaxed) < target(); });
+        if (stopping)
+        {
+            return;
+        }
+
+        // Don't hold up advance and wait while the kernel does the real work
+        std::size_t start = populated.load(std::memory_order_relaxed);
+        std::size_t end = target();
+        guard.unlock();
+        populate(start, end);
+        guard.lock();
+
+        populated.store(end, std::memory_order_relaxed);
+        if (end >= target())
+        {
+            caughtUp.notify_all();
+        }
+    }
+}
+
+void Prefaulter::populate(std::size_t start, std::size_t end)
+{
+#if defined(MADV_POPULATE_WRITE) && defined(MADV_POPULATE_READ)
+    // madvise wants whole pages. The pages at either end of the region are partly ours, so
+    // they're mapped.
+    std::uintptr_t first = reinterpret_cast<std::uintptr_t>(memory + start) / pageSize * pageSize;
+    std::uintptr_t last = (reinterpret_cast<std::uintptr_t>(memory + end) + pageSize - 1) / pageSize * pageSize;
+    int advice = access == Access::Write ? MADV_POPULATE_WRITE : MADV_POPULATE_READ;
+    if (madvise(reinterpret_cast<void*>(first), last - first, advice) == 0)
+    {
+        return;
+    }
+#endif
+    // The heap may be using these bytes, so the touch mustn't change them.
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(memory + start);
+    std::uintptr_t limit = reinterpret_cast<std::uintptr_t>(memory + end);
+    while (address < limit)
+    {
+        std::atomic_ref<char> byte(*reinterpret_cast<char*>(address));
+        if (access == Access::Write)
+        {
+            byte.fetch_add(0, std::memory_order_relaxed);
+        }
+        else
+        {
+            byte.load(std::memory_order_relaxed);
+        }
+        address = (address / pageSize + 1) * pageSize;
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+// Takes page faults out of the allocation path. The first touch of each page of a fresh region
+// faults, and with an address-ordered heap that happens in whichever malloc first splits into the
+// page. A Prefaulter keeps the pages within a lookahead of the allocation frontier (the end of the
+// highest block handed out so far) populated from a background thread, so those faults are
+// already taken by the time malloc gets there.
+//
+// Pages are populated with madvise(MADV_POPULATE_WRITE) where it's available, which doesn't touch
+// their contents. Otherwise, the worker touches each page with an atomic add of 0, which leaves
+// its contents alone too. Either way, the pages count as written, which is fine for anonymous
+// memory but dirties the pages of a shared file mapping (and fills in a sparse file). Prefault
+// those for reading instead, with MADV_POPULATE_READ or a plain load per page. Writes then still
+// take a minor fault, but the page is already read in.
+//
+// To have a Schurmalloc drive it, use the BackgroundPrefault policy below. A Prefaulter can also
+// be driven by hand, for memory that something else hands out.
+class Prefaulter
+{
+public:
+    Prefaulter() = delete;
+    Prefaulter(const Prefaulter&) = delete;
+    Prefaulter& operator=(const Prefaulter&) = delete;
+
+    // Write: Populate pages writable. For anonymous memory.
+    // Read: Populate pages without dirtying them. For file mappings.
+    enum class Access { Write, Read };
+
+    // mem, size: The region to prefault, e.g. the block of memory given to a Schurmalloc.
+    // lookahead: How many bytes past the frontier to keep populated. The first lookahead bytes
+    //   start being populated right away.
+    Prefaulter(void* mem, std::size_t size, std::size_t lookahead, Access access = Access::Write);
+
+    // Stops the worker, whether or not it's caught up.
+    ~Prefaulter();
+
+    // Tells the prefaulter that the memory before end is in use, e.g. with the end of each block
+    // malloc returns. This is a couple of atomic operations unless it moves the frontier far
+    // enough to give the worker something to do.
+    void advance(void* end);
+
+    // Blocks until everything within the lookahead of the frontier has been populated.
+    void wait();
+
+    // How many bytes from the start of the region have been populated.
+    std::size_t getPopulated();
+
+private:
+    char* memory;
+    std::size_t size;
+    std::size_t lookahead;
+    Access access;
+    std::size_t pageSize;
+
+    // Offsets into the region. frontier only goes up. The worker populates up to frontier +
+    // lookahead, and populated is how far it's got.
+    std::atomic<std::size_t> frontier;
+    std::atomic<std::size_t> populated;
+
+    bool stopping;
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable caughtUp;
+    std::thread worker;
+
+    // How far the worker should have populated
+    std::size_t target();
+
+    void work();
+    void populate(std::size_t start, std::size_t end);
+};
+
+// A prefault policy that runs a Prefaulter over the heap's memory, lookahead bytes ahead of the
+// end of the highest block the heap has handed out. The heap advances it on every malloc and on
+// every realloc that grows a block in place. A file-backed heap needs Access::Read.
+template <std::size_t Lookahead = 16 * 1024 * 1024, Prefaulter::Access Access = Prefaulter::Access::Write>
+class BackgroundPrefault
+{
+public:
+    static constexpr bool enabled = true;
+    static constexpr bool dirties = Access == Prefaulter::Access::Write;
+    static constexpr std::size_t lookahead = Lookahead;
+
+    // The prefault policy interface, which Schurmalloc calls under its lock
+    void attach(void* mem, std::size_t size)
+    {
+        prefaulter.emplace(mem, size, lookahead, Access);
+    }
+    void advance(void* end)
+    {
+        prefaulter->advance(end);
+    }
+
+    // See Prefaulter.
+    void wait()
+    {
+        prefaulter->wait();
+    }
+    std::size_t getPopulated()
+    {
+        return prefaulter->getPopulated();
+    }
+
+private:
+    // Started once the heap attaches, since that's when the memory is known
+    std::optional<Prefaulter> prefaulter;
+};
@@ -1,40 +1,315 @@
 #pragma once
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 
+//////////////////////////////
+///////// Policies ///////////
+//////////////////////////////
+
+// Schurmalloc is configured at compile time by a bundle of policies (see DefaultPolicies). Each
+// policy is resolved when the template is instantiated, so a build doesn't pay runtime branches
+// for features it doesn't use. To change one policy, derive from DefaultPolicies and override it.
+
+// Fit policies choose which block of the address-ordered free list a malloc of size bytes gets.
+// They return NULL if no free block is large enough.
+struct FirstFit
+{
+    template <class Header>
+    static Header* find(Header* freeList, std::size_t size)
+    {
+        for (Header* block = freeList; block; block = block->next)
+        {
+            if (block->size >= size)
+            {
+                return block;
+            }
+        }
+        return NULL;
+    }
+};
+
+struct BestFit
+{
+    template <class Header>
+    static Header* find(Header* freeList, std::size_t size)
+    {
+        Header* best = NULL;
+        for (Header* block = freeList; block; block = block->next)
+        {
+            if (block->size == size)
+            {
+                return block;
+            }
+            if (block->size > size && (!best || block->size < best->size))
+            {
+                best = block;
+            }
+        }
+        return best;
+    }
+};
+
+// Split policy: a block is only split if the remainder can hold MinPayload bytes on top of its
+// own header and footer. Otherwise the whole block is handed out.
+template <std::size_t MinPayload>
+struct MinRemainderSplit
+{
+    static_assert(MinPayload > 0, "A split must leave a remainder with a payload");
+    static constexpr std::size_t minPayload = MinPayload;
+};
+
+// Stats policies are told about every successful malloc, realloc and free, with block sizes.
+struct NoStats
+{
+    void onMalloc(std::size_t) {}
+    void onRealloc(std::size_t, std::size_t) {}
+    void onFree(std::size_t) {}
+};
+
+struct CountingStats
+{
+    std::size_t mallocs = 0;
+    std::size_t reallocs = 0;
+    std::size_t frees = 0;
+    std::size_t bytesInUse = 0;
+    std::size_t peakBytesInUse = 0;
+
+    void onMalloc(std::size_t size)
+    {
+        mallocs++;
+        grow(size);
+    }
+
+    void onRealloc(std::size_t oldSize, std::size_t newSize)
+    {
+        reallocs++;
+        bytesInUse -= oldSize;
+        grow(newSize);
+    }
+
+    void onFree(std::size_t size)
+    {
+        frees++;
+        bytesInUse -= size;
+    }
+
+private:
+    void grow(std::size_t size)
+    {
+        bytesInUse += size;
+        if (bytesInUse > peakBytesInUse)
+        {
+            peakBytesInUse = bytesInUse;
+        }
+    }
+};
+
+// Lock policies guard malloc, realloc and free. Any BasicLockable works, e.g. std::mutex.
+struct NoLock
+{
+    void lock() {}
+    void unlock() {}
+};
+
+// Profiler policies are asked whether to sample each allocation, and told when a sampled block
+// is freed. A sample comes with its caller: the return address of the heap's public entry point,
+// so the profiler can tell the allocator's own frames from the call site's. See heapProfiler.h
+// for SamplingProfiler. With enabled false, none of the profiling code is compiled in.
+struct NoProfiler
+{
+    static constexpr bool enabled = false;
+    bool shouldSample(std::size_t) { return false; }
+    void recordSample(void*, std::size_t, void*) {}
+    void dropSample(void*) {}
+};
+
+// Prefault policies are given the heap's memory when it's constructed, and told the end of each
+// block the heap hands out, which moves the allocation frontier. See prefaulter.h for
+// BackgroundPrefault. With enabled false, none of the prefaulting code is compiled in.
+// dirties: Whether prefaulting writes to pages (or maps them writable, which marks them dirty). A
+//   file-backed heap can't use a policy that does, since the file would be written back and
+//   filled in for the whole lookahead.
+struct NoPrefault
+{
+    static constexpr bool enabled = false;
+    static constexpr bool dirties = false;
+    void attach(void*, std::size_t) {}
+    void advance(void*) {}
+};
+
+// Fit: A fit policy, e.g. FirstFit or BestFit.
+// Split: A split policy, e.g. MinRemainderSplit.
+// alignment: Requested sizes are rounded up to a multiple of this, which (with an aligned block
+//   of memory) keeps payloads aligned. Must be a power of 2 that divides the metadata sizes.
+// Stats: A stats policy, e.g. NoStats or CountingStats.
+// Lock: A lock policy, e.g. NoLock or std::mutex.
+// Profiler: A profiler policy, e.g. NoProfiler or SamplingProfiler.
+// Prefault: A prefault policy, e.g. NoPrefault or BackgroundPrefault.
+// wilderness: Whether to keep the free block at the end of memory (the top chunk) out of the free
+//   list. It's only used when no block in the free list fits, and a block right before it can
+//   grow into it without touching the free list.
+// cacheLine: The cache line size that mallocIsolated lays payloads out on. Must be a power of 2
+//   that's a multiple of alignment.
+// checks: Whether to run the sanity check assertions.
+// trace: Whether to print what the allocator is doing to stdout.
+struct DefaultPolicies
+{
+    using Fit = FirstFit;
+    using Split = MinRemainderSplit<1>;
+    static constexpr std::size_t alignment = 1;
+    using Stats = NoStats;
+    using Lock = NoLock;
+    using Profiler = NoProfiler;
+    using Prefault = NoPrefault;
+    static constexpr bool wilderness = false;
+    static constexpr std::size_t cacheLine = 64;
+    static constexpr bool checks = true;
+    static constexpr bool trace = true;
+};
+
 // Simulates malloc and free by using a fixed block of memory as if it's the entire heap.
-class Schurmalloc
+template <class Policies = DefaultPolicies>
+class BasicSchurmalloc
 {
 public:
-    Schurmalloc() = delete;
+    BasicSchurmalloc() = delete;
+    BasicSchurmalloc(const BasicSchurmalloc&) = delete;
+    BasicSchurmalloc& operator=(const BasicSchurmalloc&) = delete;
 
     // mem is the block of memory in which malloc will be simulated.
     // size is the size of that block in bytes.
-    Schurmalloc(void* mem, std::size_t size);
+    BasicSchurmalloc(void* mem, std::size_t size);
+
+    // How a Schurmalloc treats the block of memory it's given.
+    // Volatile: All of memory is formatted as one free block.
+    // Persistent: Memory starts with a heap superblock. If the superblock is valid, we attach to the
+    //   heap that's already in memory instead of formatting it again. Otherwise, we format a fresh heap.
+    enum class Persistence { Volatile, Persistent };
+
+    // What a persistent Schurmalloc found in its memory when it was constructed.
+    // Formatted: There was no valid heap, so we formatted a fresh one.
+    // Attached: The heap was shut down cleanly, so we picked it up as-is.
+    // Recovered: The heap wasn't shut down cleanly, so we rebuilt it from its boundary tags.
+    enum class OpenState { Formatted, Attached, Recovered };
+
+    BasicSchurmalloc(void* mem, std::size_t size, Persistence persistence);
+
+    // The smallest block of memory a volatile Schurmalloc can be given: room for one block with a
+    // byte of payload. (A persistent one also needs room for its superblock.)
+    static std::size_t getMinSize();
+
+    // If mem holds a persistent heap, returns the address mem was at when that heap was last
+    // attached. Mapping mem there again saves relocating the free list (and keeps any pointers the
+    // user stored in the heap valid). Returns NULL if mem doesn't hold a persistent heap.
+    static void* getPreferredAddress(void* mem, std::size_t size);
+
+    // Persistent mode only. The root object is how the user finds their data again after reopening.
+    OpenState getOpenState() const;
+    void* getRoot();
+    void setRoot(void* root);
+
+    // Persistent mode only. Records the free list and marks the heap as cleanly shut down, so the
+    // next attach can skip recovery. Don't use the Schurmalloc after calling this.
+    void shutdown();
 
     void* malloc(std::size_t size);
     void* realloc(void* ptr, std::size_t newSize);
     void free(void* ptr);
 
+    // Like malloc, but the payload starts on a cache line boundary and is rounded up to whole cache
+    // lines, so no metadata or other block shares its lines. Objects written by different threads
+    // then can't falsely share a line. Free it with free as usual. realloc doesn't keep the
+    // isolation if it has to move the block.
+    void* mallocIsolated(std::size_t size);
+
+    // Frees count blocks while holding the lock once.
+    void freeBatch(void* const* ptrs, std::size_t count);
+
+    const typename Policies::Stats& getStats() const;
+
+    // A copy of the stats taken under the lock, for reading them while other threads use the heap.
+    typename Policies::Stats copyStats();
+
+    // A snapshot of the free space in the heap, for measuring fragmentation.
+    // totalBytes, largestBlock: Payload bytes, not counting metadata.
+    // blocks: How many free blocks there are, including the top chunk.
+    struct FreeSpace
+    {
+        std::size_t totalBytes;
+        std::size_t largestBlock;
+        std::size_t blocks;
+    };
+    FreeSpace getFreeSpace();
+
+    // The profiler policy. Hold no other references to it while the heap is in use by other
+    // threads, since the heap only touches it under its lock.
+    typename Policies::Profiler& getProfiler();
+
+    // The prefault policy, e.g. to wait for it to catch up.
+    typename Policies::Prefault& getPrefault();
+
     // Run a suite of tests on Schurmalloc
     static void test();
     
 private:
+    template <class> friend class BasicSchurmalloc;
+
+    static constexpr std::size_t alignment = Policies::alignment;
+    static_assert(alignment > 0 && (alignment & (alignment - 1)) == 0, "alignment must be a power of 2");
+
+    static constexpr std::size_t cacheLine = Policies::cacheLine;
+    static_assert((cacheLine & (cacheLine - 1)) == 0 && cacheLine % alignment == 0,
+                  "cacheLine must be a power of 2 and a multiple of alignment");
+
+
     // The block of memory in which we simulate malloc. Creator of Schurmalloc is responsible
     // for freeing this memory!
     void* memory;
     std::size_t memorySize;
 
+    // A persistent heap starts with a superblock, and the heap proper (memory) follows it.
+    // Offsets are from the start of the heap proper, so they survive the heap moving.
+    // magic, version: Identify a heap that we know how to attach to.
+    // heapSize: memorySize when the heap was formatted.
+    // base: The address of the heap proper when it was last attached.
+    // rootOffset: The offset of the user's root object, or noOffset if there isn't one.
+    // freeListOffset: The offset of the head of the free list at shutdown, or noOffset if it was empty.
+    // cleanShutdown: Nonzero if shutdown() was called after the last attach.
+    struct Superblock
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::size_t heapSize;
+        std::uintptr_t base;
+        std::size_t rootOffset;
+        std::size_t freeListOffset;
+        std::uint32_t cleanShutdown;
+    };
+
+    static const std::uint32_t superblockMagic = 0x4d484353; // "SCHM"
+    static const std::uint32_t superblockVersion = 1;
+    static const std::size_t noOffset = static_cast<std::size_t>(-1);
+
+    // The space reserved for the superblock, which keeps the heap proper aligned.
+    static constexpr std::size_t superblockSpace = (sizeof(Superblock) + alignment - 1) & ~(alignment - 1);
+
+    // NULL in volatile mode
+    Superblock* superblock;
+    OpenState openState;
+
     // Each block of memory in the free list has a header and a footer. From these headers, we
     // form a linked list of free blocks.
     // size: The size of the block following this header. Doesn't include the size of the footer.
     // free: Indicates whether this block is free and reservable
+    // sampled: For a reserved block, whether the profiler sampled it. (It fits in free's padding.)
     // prev: Forms the linked list of free blocks. NULL if this is the first block in the free list.
     // next: Forms the linked list of free blocks. NULL if this is the last block in the free list.
     struct Header
     {
         std::size_t size;
         bool free;
+        bool sampled;
         Header* prev;
         Header* next;
     };
@@ -47,9 +322,44 @@ private:
         bool free;
     };
     
+    static_assert(sizeof(Header) % alignment == 0 && sizeof(Footer) % alignment == 0,
+                  "alignment must divide the metadata sizes");
+
     // The linked list of free blocks
     Header* freeList;
 
+    // With the wilderness policy, the free block at the end of memory, which isn't in freeList.
+    // NULL if the last block isn't free (or without the wilderness policy).
+    Header* top;
+
+    typename Policies::Stats stats;
+    typename Policies::Lock lock;
+    typename Policies::Profiler profiler;
+    typename Policies::Prefault prefault;
+
+    // Rounds size up to a multiple of alignment
+    static std::size_t alignSize(std::size_t size);
+
+    // The unlocked guts of malloc, realloc and free. Internally, we always call these, since
+    // the lock is already held.
+    void* mallocImpl(std::size_t size);
+    void* reallocImpl(void* ptr, std::size_t newSize);
+    void freeImpl(void* ptr);
+    void* mallocIsolatedImpl(std::size_t size);
+
+    // How far into block's payload a cache-line-aligned payload can start. Unless it's 0, it
+    // leaves room in front for a free block, which is split off.
+    std::size_t isolationGap(Header* block);
+
+    // Tell the profiler about a successful allocation or a free. They compile away without a profiler.
+    // caller: The return address of the public entry point.
+    void profileMalloc(void* ptr, std::size_t size, void* caller);
+    void profileFree(void* ptr);
+
+    // Moves the prefault policy's frontier up to the end of block, which is in use now. Compiles
+    // away without prefaulting.
+    void prefaultThrough(Header* block);
+
     // Is this the first or the last block in the whole block of available memory?
     bool isFirstBlock(Header* header);
     bool isLastBlock(Footer* footer);
@@ -78,6 +388,28 @@ private:
     // Reserves a free block by marking it as reserved and removing it from the free list
     void reserve(Header* block);
 
+    // Removes a block from the free list
+    void unlink(Header* block);
+
+    // With the wilderness policy, takes the last block out of the free list to be the top chunk,
+    // if it's free. Otherwise, just sets top to NULL.
+    void detachTop();
+
+    // Reserves size bytes from the front of the top chunk.
+    Header* reserveFromTop(std::size_t size);
+
+    // Formats all of memory as one free block.
+    void format();
+
+    // Fixes up the free list of a cleanly shut down heap that was last attached at oldBase.
+    void relocate(std::uintptr_t oldBase);
+
+    // Rebuilds the free list of a heap that wasn't shut down cleanly by walking its boundary tags.
+    // Adjacent free blocks (left behind by a crash mid-free) are coalesced. If the tags stop making
+    // sense partway through, the rest of the heap is fenced off as a reserved block, since it might
+    // still hold live data.
+    void recover();
+
     //////////////////////////////
     /////// Test resources ///////
     //////////////////////////////
@@ -91,4 +423,24 @@ private:
     };
 
     void verifyMemory(const std::vector<TB>& expectedMemory, const std::vector<size_t>& expectedFreeList);
+
+    static void testPersistence();
+    static void testPolicies();
+    static void testSlotPool();
+    static void testMaintenance();
+    static void testWilderness();
+    static void testProfiler();
+    static void testHugePages();
+    static void testLifetimes();
+    static void testSubHeaps();
+    static void testIsolation();
+    static void testPrefault();
 };
+
+// The allocator with the default policies, which behaves like the original Schurmalloc.
+using Schurmalloc = BasicSchurmalloc<>;
+
+// The test suite (schurmallocTest.cpp) runs on the default policies.
+template <> void BasicSchurmalloc<DefaultPolicies>::test();
+
+#include "schurmallocImpl.h"
@@ -0,0 +1,536 @@
+#include "schurmalloc.h"
+#include "hugePageRegion.h"
+#include "lifetimeHeap.h"
+#include "prefaulter.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <new>
+#include <random>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using std::cout;
+using std::vector;
+
+// Benchmarks for Schurmalloc. Unlike the tests, these turn off sanity checks and tracing.
+
+struct BenchPolicies : DefaultPolicies
+{
+    static constexpr bool checks = false;
+    static constexpr bool trace = false;
+};
+
+struct BestFitPolicies : BenchPolicies
+{
+    using Fit = BestFit;
+};
+
+template <class Base>
+struct WithWilderness : Base
+{
+    static constexpr bool wilderness = true;
+};
+
+template <class Base>
+struct WithPrefault : Base
+{
+    using Prefault = BackgroundPrefault<16 << 20>;
+};
+
+// Mixed-size soak: mostly small blocks with some medium ones, kept at about 85% of the heap.
+// Every 100 operations, we try a large request (and free it again if it succeeds). Reports how
+// often large requests succeed, and fragmentation (1 - largest free block / total free) sampled
+// along the way.
+template <class Policies>
+static void benchMixedSizes(const char* name)
+{
+    const std::size_t heapSize = 8 << 20;
+    const std::size_t targetLive = heapSize / 20 * 17;
+    const int ops = 200000;
+
+    void* memory = std::malloc(heapSize);
+    BasicSchurmalloc<Policies> schurm(memory, heapSize);
+    std::mt19937 rng(12345);
+
+    struct Live
+    {
+        void* ptr;
+        std::size_t size;
+    };
+    vector<Live> live;
+    std::size_t liveBytes = 0;
+    int largeTries = 0;
+    int largeSuccesses = 0;
+    int smallFailures = 0;
+    double fragmentationSum = 0;
+    int fragmentationSamples = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ops; i++)
+    {
+        if (liveBytes < targetLive || live.empty())
+        {
+            std::size_t size = rng() % 10 == 0 ? 1024 + rng() % (16 << 10) : 16 + rng() % 512;
+            void* ptr = schurm.malloc(size);
+            if (ptr)
+            {
+                live.push_back({ptr, size});
+                liveBytes += size;
+            }
+            else
+            {
+                smallFailures++;
+            }
+        }
+        else
+        {
+            std::size_t victim = rng() % live.size();
+            schurm.free(live[victim].ptr);
+            liveBytes -= live[victim].size;
+            live[victim] = live.back();
+            live.pop_back();
+        }
+
+        if (i % 100 == 0)
+        {
+            largeTries++;
+            void* ptr = schurm.malloc((64 << 10) + rng() % (192 << 10));
+            if (ptr)
+            {
+                largeSuccesses++;
+                schurm.free(ptr);
+            }
+        }
+
+        if (i % 1000 == 0)
+        {
+            typename BasicSchurmalloc<Policies>::FreeSpace space = schurm.getFreeSpace();
+            if (space.totalBytes)
+            {
+                fragmentationSum += 1.0 - static_cast<double>(space.largestBlock) / space.totalBytes;
+                fragmentationSamples++;
+            }
+        }
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    cout << name << ":\n";
+    cout << "\tlarge requests succeeded: " << largeSuccesses << "/" << largeTries
+         << " (" << 100.0 * largeSuccesses / largeTries << "%)\n";
+    cout << "\tfailed small/medium requests: " << smallFailures << "\n";
+    cout << "\tmean fragmentation: " << 100.0 * fragmentationSum / fragmentationSamples << "%\n";
+    cout << "\ttime: " << elapsed.count() << " ms\n";
+
+    for (Live& block : live)
+    {
+        schurm.free(block.ptr);
+    }
+    std::free(memory);
+}
+
+// The lifetime soak runs the same workload on a plain heap, which ignores lifetime hints, and
+// on a LifetimeHeap, with the hints or with Auto. Each adapter tracks peak footprint (how far
+// into its memory the highest allocated byte has been) and measures fragmentation: the fraction
+// of free bytes that aren't in the largest free block of their (sub-)heap.
+struct PlainAdapter
+{
+    BasicSchurmalloc<BenchPolicies> heap;
+    char* base;
+    std::size_t highWater;
+
+    PlainAdapter(void* mem, std::size_t size) : heap(mem, size), base(static_cast<char*>(mem)), highWater(0) {}
+
+    void* malloc(std::size_t size, Lifetime)
+    {
+        void* ptr = heap.malloc(size);
+        if (ptr && static_cast<std::size_t>(static_cast<char*>(ptr) + size - base) > highWater)
+        {
+            highWater = static_cast<char*>(ptr) + size - base;
+        }
+        return ptr;
+    }
+    void free(void* ptr) { heap.free(ptr); }
+    std::size_t getPeakFootprint() { return highWater; }
+    std::size_t getFreeBlocks() { return heap.getFreeSpace().blocks; }
+    double getFragmentation()
+    {
+        BasicSchurmalloc<BenchPolicies>::FreeSpace space = heap.getFreeSpace();
+        return space.totalBytes ? 1.0 - static_cast<double>(space.largestBlock) / space.totalBytes : 0;
+    }
+};
+
+template <bool automatic>
+struct LifetimeAdapter
+{
+    BasicLifetimeHeap<BenchPolicies> heap;
+
+    LifetimeAdapter(void* mem, std::size_t size) : heap(mem, size, 0.3, 0.65) {}
+
+    void* malloc(std::size_t size, Lifetime lifetime) { return heap.malloc(size, automatic ? Lifetime::Auto : lifetime); }
+    void free(void* ptr) { heap.free(ptr); }
+    std::size_t getPeakFootprint() { return heap.getPeakFootprint(); }
+    std::size_t getFreeBlocks()
+    {
+        std::size_t blocks = 0;
+        for (Lifetime lifetime : {Lifetime::Short, Lifetime::Long, Lifetime::Permanent})
+        {
+            blocks += heap.getHeap(lifetime)->getFreeSpace().blocks;
+        }
+        return blocks;
+    }
+    double getFragmentation()
+    {
+        std::size_t total = 0;
+        std::size_t largest = 0;
+        for (Lifetime lifetime : {Lifetime::Short, Lifetime::Long, Lifetime::Permanent})
+        {
+            BasicSchurmalloc<BenchPolicies>::FreeSpace space = heap.getHeap(lifetime)->getFreeSpace();
+            total += space.totalBytes;
+            largest += space.largestBlock;
+        }
+        return total ? 1.0 - static_cast<double>(largest) / total : 0;
+    }
+};
+
+// Lifetime soak: a server-like mix of short-lived request buffers (freed in FIFO order after 64
+// more), long-lived cache entries (evicted at random once the cache is full), and a trickle of
+// permanent blocks. Reports fragmentation and the number of free blocks (sampled along the way),
+// and peak footprint.
+template <class Heap>
+static void benchLifetimes(const char* name)
+{
+    const std::size_t heapSize = 8 << 20;
+    const int ops = 400000;
+    const std::size_t requestsInFlight = 64;
+    const std::size_t cacheCapacity = 9000;
+
+    void* memory = std::malloc(heapSize);
+    Heap heap(memory, heapSize);
+    std::mt19937 rng(12345);
+
+    std::deque<void*> requests;
+    vector<void*> cache;
+    int failures = 0;
+    double fragmentationSum = 0;
+    double blocksSum = 0;
+    int samples = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ops; i++)
+    {
+        void* request = heap.malloc(512 + rng() % (7 << 10), Lifetime::Short);
+        if (request)
+        {
+            requests.push_back(request);
+        }
+        else
+        {
+            failures++;
+        }
+        if (requests.size() > requestsInFlight)
+        {
+            heap.free(requests.front());
+            requests.pop_front();
+        }
+
+        if (rng() % 4 == 0)
+        {
+            if (cache.size() == cacheCapacity)
+            {
+                std::size_t victim = rng() % cache.size();
+                heap.free(cache[victim]);
+                cache[victim] = cache.back();
+                cache.pop_back();
+            }
+            void* entry = heap.malloc(64 + rng() % 960, Lifetime::Long);
+            if (entry)
+            {
+                cache.push_back(entry);
+            }
+            else
+            {
+                failures++;
+            }
+        }
+
+        if (i % 500 == 0 && !heap.malloc(32 + rng() % 224, Lifetime::Permanent))
+        {
+            failures++;
+        }
+
+        if (i % 1000 == 0)
+        {
+            fragmentationSum += heap.getFragmentation();
+            blocksSum += heap.getFreeBlocks();
+            samples++;
+        }
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    cout << name << ":\n";
+    cout << "\tfailed requests/cache entries/permanent blocks: " << failures << "\n";
+    cout << "\tmean fragmentation: " << 100.0 * fragmentationSum / samples << "%\n";
+    cout << "\tmean free blocks: " << blocksSum / samples << "\n";
+    cout << "\tpeak footprint: " << heap.getPeakFootprint() / 1024 << " KiB\n";
+    cout << "\ttime: " << elapsed.count() << " ms\n";
+
+    std::free(memory);
+}
+
+// False sharing: each thread bumps its own atomic counter. With malloc, the counters (and the
+// headers and footers between them) are packed together, so threads on different cores fight over
+// the same cache lines. With mallocIsolated, each counter has its lines to itself.
+template <bool isolated>
+static void benchCounters(const char* name)
+{
+    const std::size_t heapSize = 1 << 20;
+    const std::size_t increments = 20000000;
+    unsigned threadCount = std::thread::hardware_concurrency();
+    threadCount = threadCount < 2 ? 2 : threadCount > 8 ? 8 : threadCount;
+
+    void* memory = std::malloc(heapSize);
+    BasicSchurmalloc<BenchPolicies> schurm(memory, heapSize);
+    vector<std::atomic<std::uint64_t>*> counters;
+    for (unsigned i = 0; i < threadCount; i++)
+    {
+        void* ptr = isolated ? schurm.mallocIsolated(sizeof(std::atomic<std::uint64_t>))
+                             : schurm.malloc(sizeof(std::atomic<std::uint64_t>));
+        counters.push_back(new (ptr) std::atomic<std::uint64_t>(0));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    vector<std::thread> threads;
+    for (unsigned i = 0; i < threadCount; i++)
+    {
+        std::atomic<std::uint64_t>* counter = counters[i];
+        threads.emplace_back([counter, increments] {
+            for (std::size_t j = 0; j < increments; j++)
+            {
+                counter->fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    cout << name << " (" << threadCount << " threads):\n";
+    cout << "\tcounters " << static_cast<void*>(counters[0]) << " and " << static_cast<void*>(counters[1])
+         << " are " << reinterpret_cast<char*>(counters[1]) - reinterpret_cast<char*>(counters[0]) << " bytes apart\n";
+    cout << "\ttime: " << elapsed.count() << " ms (" << elapsed.count() * 1e6 / (increments * threadCount)
+         << " ns per increment)\n";
+
+    for (std::atomic<std::uint64_t>* counter : counters)
+    {
+        schurm.free(counter);
+    }
+    std::free(memory);
+}
+
+// Warm-up latency: a fresh 256 MiB region of regular pages, which we fill with blocks of 1-16 KiB.
+// Each malloc (and the caller's first write to the block) faults in the pages it's the first to
+// touch. With BackgroundPrefault running 16 MiB ahead of the frontier, those faults should
+// already have been taken by the worker. Reports latency percentiles of malloc plus the first write.
+template <class Policies>
+static void benchWarmup(const char* name)
+{
+    const std::size_t heapSize = 256 << 20;
+    const int allocations = 20000;
+
+    HugePageRegion region(heapSize, HugePageRegion::Mode::None);
+    if (region.getMemory() == NULL)
+    {
+        cout << name << ": couldn't map the region\n";
+        return;
+    }
+    BasicSchurmalloc<Policies> schurm(region.getMemory(), region.getSize());
+    std::mt19937 rng(12345);
+
+    vector<double> latencies;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < allocations; i++)
+    {
+        std::size_t size = 1024 + rng() % (15 << 10);
+        auto before = std::chrono::steady_clock::now();
+        char* ptr = static_cast<char*>(schurm.malloc(size));
+        if (ptr == NULL)
+        {
+            break;
+        }
+        std::memset(ptr, 1, size);
+        std::chrono::duration<double, std::micro> latency = std::chrono::steady_clock::now() - before;
+        latencies.push_back(latency.count());
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) { return latencies[static_cast<std::size_t>(p * (latencies.size() - 1))]; };
+    cout << name << " (" << latencies.size() << " allocations):\n";
+    cout << "\tmalloc + first write: p50 " << percentile(0.5) << " us, p99 " << percentile(0.99)
+         << " us, p99.9 " << percentile(0.999) << " us, max " << latencies.back() << " us\n";
+    cout << "\ttime: " << elapsed.count() << " ms\n";
+}
+
+// Counts data TLB load misses in this thread, using perf_event_open. Where that's unavailable
+// (not Linux, or perf_event_paranoid forbids it), available() is false and the count is 0.
+class TlbMissCounter
+{
+public:
+    TlbMissCounter()
+    {
+        fd = -1;
+#ifdef __linux__
+        perf_event_attr attr = {};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~TlbMissCounter()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+#endif
+    }
+
+    bool available()
+    {
+        return fd >= 0;
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    std::uint64_t stop()
+    {
+        std::uint64_t count = 0;
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count))
+            {
+                count = 0;
+            }
+        }
+#endif
+        return count;
+    }
+
+private:
+    int fd;
+};
+
+// TLB reach: a 128 MiB heap on a HugePageRegion, filled with 64-byte nodes that are linked in a
+// random order, then walked. Nearly every step lands on a different page, so with 4 KiB pages
+// most steps miss the TLB, while 2 MiB pages cover the whole heap with 64 TLB entries.
+static void benchTlbReach(HugePageRegion::Mode mode, const char* name)
+{
+    const std::size_t heapSize = 128 << 20;
+    const std::size_t steps = 20000000;
+
+    struct Node
+    {
+        Node* next;
+        char payload[56];
+    };
+
+    HugePageRegion region(heapSize, mode);
+    if (region.getMemory() == NULL)
+    {
+        cout << name << ": couldn't map the region\n";
+        return;
+    }
+    BasicSchurmalloc<BenchPolicies> schurm(region.getMemory(), region.getSize());
+
+    vector<Node*> nodes;
+    while (Node* node = static_cast<Node*>(schurm.malloc(sizeof(Node))))
+    {
+        nodes.push_back(node);
+    }
+    std::mt19937 rng(12345);
+    std::shuffle(nodes.begin(), nodes.end(), rng);
+    for (std::size_t i = 0; i < nodes.size(); i++)
+    {
+        nodes[i]->next = nodes[(i + 1) % nodes.size()];
+    }
+
+    TlbMissCounter counter;
+    Node* node = nodes[0];
+    auto start = std::chrono::steady_clock::now();
+    counter.start();
+    for (std::size_t i = 0; i < steps; i++)
+    {
+        node = node->next;
+    }
+    std::uint64_t misses = counter.stop();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    const char* got = region.getMode() == HugePageRegion::Mode::None ? "regular pages" :
+                      region.getMode() == HugePageRegion::Mode::Transparent ? "transparent huge pages" : "explicit huge pages";
+    cout << name << " (" << got << ", " << nodes.size() << " nodes):\n";
+    if (counter.available())
+    {
+        cout << "\tdTLB load misses: " << misses << " (" << static_cast<double>(misses) / steps << " per step)\n";
+    }
+    else
+    {
+        cout << "\tdTLB load misses: unavailable (no perf_event_open)\n";
+    }
+    cout << "\ttime: " << elapsed.count() << " ms (" << elapsed.count() * 1e6 / steps << " ns per step)";
+    // Keeps the walk from being optimized away
+    cout << (node ? "\n" : "\n\n");
+
+    // No need to free the nodes, since the whole region is unmapped.
+}
+
+int main()
+{
+    benchMixedSizes<BenchPolicies>("first fit");
+    benchMixedSizes<WithWilderness<BenchPolicies>>("first fit + wilderness");
+    benchMixedSizes<BestFitPolicies>("best fit");
+    benchMixedSizes<WithWilderness<BestFitPolicies>>("best fit + wilderness");
+    benchLifetimes<PlainAdapter>("lifetime soak, one region");
+    benchLifetimes<LifetimeAdapter<false>>("lifetime soak, segregated by hint");
+    benchLifetimes<LifetimeAdapter<true>>("lifetime soak, segregated by Auto");
+    benchCounters<false>("per-thread counters, malloc");
+    benchCounters<true>("per-thread counters, mallocIsolated");
+    benchWarmup<BenchPolicies>("warm-up, no prefaulting");
+    benchWarmup<WithPrefault<BenchPolicies>>("warm-up, prefaulting 16 MiB ahead");
+    benchTlbReach(HugePageRegion::Mode::None, "pointer chase, regular pages");
+    benchTlbReach(HugePageRegion::Mode::Transparent, "pointer chase, transparent huge pages");
+    benchTlbReach(HugePageRegion::Mode::Explicit, "pointer chase, explicit huge pages");
+    return 0;
+}
@@ -0,0 +1,1142 @@
+// Definitions for schurmalloc.h, which includes this at its end. Don't include this directly.
+#pragma once
+#include <iostream>
+#include <cstddef>
+#include <cstring>
+#include <cassert>
+#include <mutex>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Sanity checks and tracing compile away entirely unless the policies ask for them.
+#define SCHURMALLOC_CHECK(cond) do { if constexpr (Policies::checks) { assert(cond); } } while (0)
+#define SCHURMALLOC_TRACE(msg) do { if constexpr (Policies::trace) { std::cout << msg; } } while (0)
+
+// The return address of the current function, i.e. where in its caller it was called from
+#ifdef _MSC_VER
+#define SCHURMALLOC_CALLER() _ReturnAddress()
+#else
+#define SCHURMALLOC_CALLER() __builtin_return_address(0)
+#endif
+
+template <class Policies>
+void* BasicSchurmalloc<Policies>::getPayload(Header* header)
+{
+    return static_cast<void*>(reinterpret_cast<char*>(header) + sizeof(Header));
+}
+
+template <class Policies>
+typename BasicSchurmalloc<Policies>::Footer* BasicSchurmalloc<Policies>::getFooter(Header* header)
+{
+    return reinterpret_cast<Footer*>(reinterpret_cast<char*>(header) + sizeof(Header) + header->size);
+}
+
+template <class Policies>
+typename BasicSchurmalloc<Policies>::Header* BasicSchurmalloc<Policies>::getHeader(void* payload)
+{
+    return reinterpret_cast<Header*>(static_cast<char*>(payload) - sizeof(Header));
+}
+
+template <class Policies>
+typename BasicSchurmalloc<Policies>::Header* BasicSchurmalloc<Policies>::getHeader(Footer* footer)
+{
+    return reinterpret_cast<Header*>(reinterpret_cast<char*>(footer) - footer->size - sizeof(Header));
+}
+
+template <class Policies>
+typename BasicSchurmalloc<Policies>::Header* BasicSchurmalloc<Policies>::getPrevHeader(Header* header)
+{
+    Footer* prevFooter = getPrevFooter(header);
+    return reinterpret_cast<Header*>(reinterpret_cast<char*>(prevFooter) - prevFooter->size - sizeof(Header));
+}
+
+template <class Policies>
+typename BasicSchurmalloc<Policies>::Footer* BasicSchurmalloc<Policies>::getPrevFooter(Header* header)
+{
+    return reinterpret_cast<Footer*>(reinterpret_cast<char*>(header) - sizeof(Footer));
+}
+
+template <class Policies>
+typename BasicSchurmalloc<Policies>::Header* BasicSchurmalloc<Policies>::getNextHeader(Header* header)
+{
+    return getNextHeader(getFooter(header));
+}
+
+template <class Policies>
+typename BasicSchurmalloc<Policies>::Header* BasicSchurmalloc<Policies>::getNextHeader(Footer* footer)
+{
+    return reinterpret_cast<Header*>(reinterpret_cast<char*>(footer) + sizeof(Footer));
+}
+
+template <class Policies>
+bool BasicSchurmalloc<Policies>::isFirstBlock(Header* header)
+{
+    return reinterpret_cast<void*>(header) == memory;
+}
+
+template <class Policies>
+bool BasicSchurmalloc<Policies>::isLastBlock(Footer* footer)
+{
+    return reinterpret_cast<char*>(footer) + sizeof(Footer) >= static_cast<char*>(memory) + memorySize;
+}
+
+template <class Policies>
+BasicSchurmalloc<Policies>::BasicSchurmalloc(void* mem, std::size_t size)
+    : BasicSchurmalloc(mem, size, Persistence::Volatile)
+{
+}
+
+template <class Policies>
+BasicSchurmalloc<Policies>::BasicSchurmalloc(void* mem, std::size_t size, Persistence persistence)
+{
+    openState = OpenState::Formatted;
+
+    if (persistence == Persistence::Volatile)
+    {
+        superblock = NULL;
+        memory = mem;
+        memorySize = size;
+        format();
+        prefault.attach(memory, memorySize);
+        return;
+    }
+
+    SCHURMALLOC_CHECK(size >= superblockSpace + getMinSize());
+    superblock = static_cast<Superblock*>(mem);
+    memory = static_cast<void*>(static_cast<char*>(mem) + superblockSpace);
+    memorySize = size - superblockSpace;
+
+    if (superblock->magic != superblockMagic ||
+        superblock->version != superblockVersion ||
+        superblock->heapSize != memorySize)
+    {
+        // This isn't a heap we can attach to, so start from scratch. Write the magic last, so
+        // that a crash partway through formatting leaves a heap we'll format again.
+        format();
+        superblock->version = superblockVersion;
+        superblock->heapSize = memorySize;
+        superblock->rootOffset = noOffset;
+        superblock->magic = superblockMagic;
+    }
+    else if (superblock->cleanShutdown)
+    {
+        // Fast path: pick up the free list right where shutdown() left it.
+        if (superblock->freeListOffset == noOffset)
+        {
+            freeList = NULL;
+        }
+        else
+        {
+            SCHURMALLOC_CHECK(superblock->freeListOffset < memorySize);
+            freeList = reinterpret_cast<Header*>(static_cast<char*>(memory) + superblock->freeListOffset);
+        }
+
+        if (superblock->base != reinterpret_cast<std::uintptr_t>(memory))
+        {
+            relocate(superblock->base);
+        }
+        detachTop();
+        openState = OpenState::Attached;
+    }
+    else
+    {
+        recover();
+        openState = OpenState::Recovered;
+    }
+
+    // The heap is live now. Until shutdown() is called, a crash will leave it marked as dirty.
+    superblock->base = reinterpret_cast<std::uintptr_t>(memory);
+    superblock->cleanShutdown = 0;
+    prefault.attach(memory, memorySize);
+}
+
+template <class Policies>
+std::size_t BasicSchurmalloc<Policies>::getMinSize()
+{
+    return sizeof(Header) + sizeof(Footer) + 1;
+}
+
+template <class Policies>
+void BasicSchurmalloc<Policies>::format()
+{
+    SCHURMALLOC_CHECK(memorySize >= getMinSize());
+
+    // Payloads are only aligned if memory is.
+    SCHURMALLOC_CHECK(reinterpret_cast<std::uintptr_t>(memory) % alignment == 0);
+
+    // Initially, all of memory is a free block.
+    // Initialize the header
+    freeList = static_cast<Header*>(memory);
+    freeList->size = memorySize - sizeof(Header) - sizeof(Footer);
+    freeList->free = true;
+    freeList->prev = NULL;
+    freeList->next = NULL;
+
+    // Find and initialize the footer
+    Footer* footer = getFooter(freeList);
+    footer->size = freeList->size;
+    footer->free = true;
+
+    // Sanity checks...
+    SCHURMALLOC_CHECK(freeList->free);
+    SCHURMALLOC_CHECK(getFooter(freeList)->free);
+    SCHURMALLOC_CHECK(freeList->prev == NULL);
+    SCHURMALLOC_CHECK(freeList->next == NULL);
+    SCHURMALLOC_CHECK(freeList->size == memorySize - sizeof(Header) - sizeof(Footer));
+    SCHURMALLOC_CHECK(freeList->size == getFooter(freeList)->size);
+
+    detachTop();
+}
+
+template <class Policies>
+void BasicSchurmalloc<Policies>::detachTop()
+{
+    top = NULL;
+    if constexpr (Policies::wilderness)
+    {
+        // Blocks tile memory exactly, so the last footer is right at the end.
+        Footer* lastFooter = reinterpret_cast<Footer*>(static_cast<char*>(memory) + memorySize - sizeof(Footer));
+        if (lastFooter->free)
+        {
+            // Being the free block with the highest address, it's the tail of the free list.
+            top = getHeader(lastFooter);
+            SCHURMALLOC_CHECK(top->next == NULL);
+            unlink(top);
+            top->prev = NULL;
+        }
+    }
+}
+
+template <class Policies>
+void BasicSchurmalloc<Policies>::relocate(std::uintptr_t oldBase)
+{
+    // Only the free list links are absolute addresses; everything else is relative to the block.
+    char* base = static_cast<char*>(memory);
+    for (Header* block = freeList; block; block = block->next)
+    {
+        if (block->prev)
+        {
+            block->prev = reinterpret_cast<Header*>(base + (reinterpret_cast<std::uintptr_t>(block->prev) - oldBase));
+        }
+        if (block->next)
+        {
+            block->next = reinterpret_cast<Header*>(base + (reinterpret_cast<std::uintptr_t>(block->next) - oldBase));
+        }
+    }
+}
+
+template <class Policies>
+void BasicSchurmalloc<Policies>::recover()
+{
+    freeList = NULL;
+    Header* lastFree = NULL;  // The tail of the rebuilt free list
+    Header* lastBlock = NULL; // The last block whose tags checked out
+
+    char* end = static_cast<char*>(memory) + memorySize;
+    char* ptr = static_cast<char*>(memory);
+    while (ptr < end)
+    {
+        Header* header = reinterpret_cast<Header*>(ptr);
+        std::size_t room = end - ptr;
+
+        // The header and footer have to agree, and the block has to fit in what's left of memory.
+        if (room < sizeof(Header) + sizeof(Footer) ||
+            header->size > room - sizeof(Header) - sizeof(Footer) ||
+            getFooter(header)->size != header->size ||
+            getFooter(header)->free != header->free)
+        {
+            SCHURMALLOC_TRACE("\trecover: Boundary tags are inconsistent. Fencing off the rest of the heap.\n");
+            if (room >= sizeof(Header) + sizeof(Footer))
+            {
+                header->size = room - sizeof(Header) - sizeof(Footer);
+                header->free = false;
+                header->prev = NULL;
+                header->next = NULL;
+                getFooter(header)->size = header->size;
+                getFooter(header)->free = false;
+            }
+            else
+            {
+                // Not even enough room for the metadata of a new block. The last good block takes
+                // the leftovers instead.
+                SCHURMALLOC_CHECK(lastBlock);
+                lastBlock->size += room;
+                getFooter(lastBlock)->size = lastBlock->size;
+                getFooter(lastBlock)->free = lastBlock->free;
+            }
+            break;
+        }
+
+        ptr = reinterpret_cast<char*>(getNextHeader(header));
+
+        if (header->free)
+        {
+            header->prev = lastFree;
+            header->next = NULL;
+            if (lastFree)
+            {
+                lastFree->next = header;
+            }
+            else
+            {
+                freeList = header;
+            }
+
+            if (lastFree && getNextHeader(lastFree) == header)
+            {
+                SCHURMALLOC_TRACE("\trecover: Coalescing adjacent free blocks...\n");
+                header = coalesce(lastFree, header);
+            }
+            lastFree = header;
+        }
+        lastBlock = header;
+    }
+
+    detachTop();
+}
+
+template <class Policies>
+void* BasicSchurmalloc<Policies>::getPreferredAddress(void* mem, std::size_t size)
+{
+    Superblock* sb = static_cast<Superblock*>(mem);
+    if (size <= superblockSpace ||
+        sb->magic != superblockMagic ||
+        sb->version != superblockVersion ||
+        sb->heapSize != size - superblockSpace)
+    {
+        return NULL;
+    }
+    return reinterpret_cast<void*>(sb->base - superblockSpace);
+}
+
+template <class Policies>
+typename BasicSchurmalloc<Policies>::OpenState BasicSchurmalloc<Policies>::getOpenState() const
+{
+    return openState;
+}
+
+template <class Policies>
+void* BasicSchurmalloc<Policies>::getRoot()
+{
+    SCHURMALLOC_CHECK(superblock);
+    if (superblock->rootOffset == noOffset)
+    {
+        return NULL;
+    }
+    return static_cast<void*>(static_cast<char*>(memory) + superblock->rootOffset);
+}
+
+template <class Policies>
+void BasicSchurmalloc<Policies>::setRoot(void* root)
+{
+    SCHURMALLOC_CHECK(superblock);
+    if (root == NULL)
+    {
+        superblock->rootOffset = noOffset;
+        return;
+    }
+    SCHURMALLOC_CHECK(static_cast<char*>(root) >= static_cast<char*>(memory));
+    SCHURMALLOC_CHECK(static_cast<char*>(root) < static_cast<char*>(memory) + memorySize);
+    superblock->rootOffset = static_cast<char*>(root) - static_cast<char*>(memory);
+}
+
+template <class Policies>
+void BasicSchurmalloc<Policies>::shutdown()
+{
+    SCHURMALLOC_CHECK(superblock);
+
+    // On disk, the top chunk is just the tail of the free list. Put it back there.
+    if (top)
+    {
+        Header* tail = freeList;
+        while (tail && tail->next)
+        {
+            tail = tail->next;
+        }
+        top->prev = tail;
+        top->next = NULL;
+        if (tail)
+        {
+            tail->next = top;
+        }
+        else
+        {
+            freeList = top;
+        }
+        top = NULL;
+    }
+
+    if (freeList)
+    {
+        superblock->freeListOffset = reinterpret_cast<char*>(freeList) - static_cast<char*>(memory);
+    }
+    else
+    {
+        superblock->freeListOffset = noOffset;
+    }
+    superblock->cleanShutdown = 1;
+}
+
+template <class Policies>
+std::size_t BasicSchurmalloc<Policies>::alignSize(std::size_t size)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+template <class Policies>
+const typename Policies::Stats& BasicSchurmalloc<Policies>::getStats() const
+{
+    return stats;
+}
+
+template <class Policies>
+typename Policies::Stats BasicSchurmalloc<Policies>::copyStats()
+{
+    std::lock_guard<typename Policies::Lock> guard(lock);
+    return stats;
+}
+
+template <class Policies>
+typename BasicSchurmalloc<Policies>::FreeSpace BasicSchurmalloc<Policies>::getFreeSpace()
+{
+    std::lock_guard<typename Policies::Lock> guard(lock);
+    FreeSpace space = {0, 0, 0};
+    for (Header* block = freeList; block; block = block->next)
+    {
+        space.totalBytes += block->size;
+        space.largestBlock = block->size > space.largestBlock ? block->size : space.largestBlock;
+        space.blocks++;
+    }
+    if (top)
+    {
+        space.totalBytes += top->size;
+        space.largestBlock = top->size > space.largestBlock ? top->size : space.largestBlock;
+        space.blocks++;
+    }
+    return space;
+}
+
+template <class Policies>
+typename Policies::Profiler& BasicSchurmalloc<Policies>::getProfiler()
+{
+    return profiler;
+}
+
+template <class Policies>
+typename Policies::Prefault& BasicSchurmalloc<Policies>::getPrefault()
+{
+    return prefault;
+}
+
+template <class Policies>
+void* BasicSchurmalloc<Policies>::malloc(std::size_t size)
+{
+    std::lock_guard<typename Policies::Lock> guard(lock);
+    void* ptr = mallocImpl(size);
+    if (ptr)
+    {
+        stats.onMalloc(getHeader(ptr)->size);
+        profileMalloc(ptr, size, SCHURMALLOC_CALLER());
+    }
+    return ptr;
+}
+
+template <class Policies>
+void* BasicSchurmalloc<Policies>::mallocIsolated(std::size_t size)
+{
+    std::lock_guard<typename Policies::Lock> guard(lock);
+    void* ptr = mallocIsolatedImpl(size);
+    if (ptr)
+    {
+        stats.onMalloc(getHeader(ptr)->size);
+        profileMalloc(ptr, size, SCHURMALLOC_CALLER());
+    }
+    return ptr;
+}
+
+template <class Policies>
+void* BasicSchurmalloc<Policies>::realloc(void* ptr, std::size_t newSize)
+{
+    std::lock_guard<typename Policies::Lock> guard(lock);
+    std::size_t oldSize = ptr ? getHeader(ptr)->size : 0;
+    bool oldSampled = Policies::Profiler::enabled && ptr && getHeader(ptr)->sampled;
+    void* newPtr = reallocImpl(ptr, newSize);
+    if (newPtr)
+    {
+        // realloc(NULL, size) is a malloc, so count it as one.
+        if (ptr)
+        {
+            stats.onRealloc(oldSize, getHeader(newPtr)->size);
+        }
+        else
+        {
+            stats.onMalloc(getHeader(newPtr)->size);
+        }
+        // The profiler sees a realloc as a free of the old block and a malloc of the new one.
+        if (oldSampled)
+        {
+            profiler.dropSample(ptr);
+        }
+        profileMalloc(newPtr, newSize, SCHURMALLOC_CALLER());
+    }
+    else if (ptr && newSize == 0)
+    {
+        stats.onFree(oldSize);
+        if (oldSampled)
+        {
+            profiler.dropSample(ptr);
+        }
+    }
+    return newPtr;
+}
+
+template <class Policies>
+void BasicSchurmalloc<Policies>::free(void* ptr)
+{
+    std::lock_guard<typename Policies::Lock> guard(lock);
+    stats.onFree(getHeader(ptr)->size);
+    profileFree(ptr);
+    freeImpl(ptr);
+}
+
+template <class Policies>
+void BasicSchurmalloc<Policies>::freeBatch(void* const* ptrs, std::size_t count)
+{
+    std::lock_guard<typename Policies::Lock> guard(lock);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        stats.onFree(getHeader(ptrs[i])->size);
+        profileFree(ptrs[i]);
+        freeImpl(ptrs[i]);
+    }
+}
+
+template <class Policies>
+void BasicSchurmalloc<Policies>::profileMalloc(void* ptr, std::size_t size, void* caller)
+{
+    if constexpr (Policies::Profiler::enabled)
+    {
+        // Every header gets written, since a reused header's flag could be left over from anything.
+        Header* header = getHeader(ptr);
+        header->sampled = profiler.shouldSample(size);
+        if (header->sampled)
+        {
+            profiler.recordSample(ptr, size, caller);
+        }
+    }
+}
+
+template <class Policies>
+void BasicSchurmalloc<Policies>::profileFree(void* ptr)
+{
+    if constexpr (Policies::Profiler::enabled)
+    {
+        // Only sampled blocks cost the profiler anything on free.
+        if (getHeader(ptr)->sampled)
+        {
+            profiler.dropSample(ptr);
+        }
+    }
+}
+
+template <class Policies>
+void BasicSchurmalloc<Policies>::prefaultThrough(Header* block)
+{
+    if constexpr (Policies::Prefault::enabled)
+    {
+        prefault.advance(reinterpret_cast<char*>(getFooter(block)) + sizeof(Footer));
+    }
+}
+
+template <class Policies>
+void* BasicSchurmalloc<Policies>::mallocImpl(std::size_t size)
+{
+    size = alignSize(size);
+    if (size == 0 || size >= memorySize)
+    {
+        return NULL;
+    }
+
+    // Find a free block that's large enough
+    Header* block = Policies::Fit::find(freeList, size);
+    if (block == NULL)
+    {
+        // Nothing in the free list fits, so this is what the top chunk is saved for.
+        if (top && top->size >= size)
+        {
+            return getPayload(reserveFromTop(size));
+        }
+        return NULL;
+    }
+
+    // We found the block to reserve!
+    // First, create a new free block out of the remainder, if there's enough remainder.
+    trySplitBlock(block, size);
+
+    // Then, reserve the block...
+    reserve(block);
+
+    // Finally, return a pointer to the address after the header
+    return getPayload(block);
+}
+
+template <class Policies>
+std::size_t BasicSchurmalloc<Policies>::isolationGap(Header* block)
+{
+    std::uintptr_t payload = reinterpret_cast<std::uintptr_t>(getPayload(block));
+    std::size_t gap = (cacheLine - payload % cacheLine) % cacheLine;
+    std::size_t minGap = sizeof(Header) + sizeof(Footer) + Policies::Split::minPayload;
+    if (gap && gap < minGap)
+    {
+        // Too small to split off, so move on by whole lines until it isn't.
+        gap += (minGap - gap + cacheLine - 1) / cacheLine * cacheLine;
+    }
+    return gap;
+}
+
+template <class Policies>
+void* BasicSchurmalloc<Policies>::mallocIsolatedImpl(std::size_t size)
+{
+    size = (alignSize(size) + cacheLine - 1) & ~(cacheLine - 1);
+    if (size == 0 || size >= memorySize)
+    {
+        return NULL;
+    }
+
+    // The split-off front needs a payload too, so a block fits if it has room for the gap and
+    // whichever is bigger of size and that payload.
+    std::size_t needed = size > Policies::Split::minPayload ? size : Policies::Split::minPayload;
+    Header* block = freeList;
+    while (block && isolationGap(block) + needed > block->size)
+    {
+        block = block->next;
+    }
+    if (block == NULL)
+    {
+        if (!top || isolationGap(top) + needed > top->size)
+        {
+            return NULL;
+        }
+        // Put the top chunk back at the tail of the free list for now, so it splits like any
+        // other free block. Whatever's left at the end becomes the top chunk again below.
+        SCHURMALLOC_TRACE("\tmallocIsolated: Nothing in the free list fits. Using the top chunk...\n");
+        block = top;
+        top = NULL;
+        Header* tail = freeList;
+        while (tail && tail->next)
+        {
+            tail = tail->next;
+        }
+        block->prev = tail;
+        block->next = NULL;
+        if (tail)
+        {
+            tail->next = block;
+        }
+        else
+        {
+            freeList = block;
+        }
+    }
+
+    std::size_t gap = isolationGap(block);
+    if (gap)
+    {
+        SCHURMALLOC_TRACE("\tmallocIsolated: Splitting off the front of the block to align the payload...\n");
+        [[maybe_unused]] bool split = trySplitBlock(block, gap - sizeof(Header) - sizeof(Footer));
+        SCHURMALLOC_CHECK(split);
+        block = getNextHeader(block);
+    }
+    SCHURMALLOC_CHECK(reinterpret_cast<std::uintptr_t>(getPayload(block)) % cacheLine == 0);
+
+    trySplitBlock(block, size);
+    reserve(block);
+    if constexpr (Policies::wilderness)
+    {
+        if (top == NULL)
+        {
+            detachTop();
+        }
+    }
+    return getPayload(block);
+}
+
+template <class Policies>
+void BasicSchurmalloc<Policies>::reserve(Header* block)
+{
+    SCHURMALLOC_CHECK(block);
+    SCHURMALLOC_CHECK(block->free);
+    SCHURMALLOC_CHECK(getFooter(block)->free);
+    SCHURMALLOC_CHECK(block->size == getFooter(block)->size);
+    SCHURMALLOC_CHECK(block != top);
+
+    unlink(block);
+
+    block->free = false;
+    getFooter(block)->free = false;
+    block->prev = NULL;
+    block->next = NULL;
+    prefaultThrough(block);
+}
+
+template <class Policies>
+void BasicSchurmalloc<Policies>::unlink(Header* block)
+{
+    if (block->prev)
+    {
+        block->prev->next = block->next;
+    }
+    else
+    {
+        // There is no previous block. That means that we're reserving the head of the
+        // free list. The free list needs to get a new head.
+        freeList = block->next;
+    }
+
+    if (block->next)
+    {
+        block->next->prev = block->prev;
+    }
+}
+
+template <class Policies>
+typename BasicSchurmalloc<Policies>::Header* BasicSchurmalloc<Policies>::reserveFromTop(std::size_t size)
+{
+    SCHURMALLOC_CHECK(top);
+    SCHURMALLOC_CHECK(top->size >= size);
+    SCHURMALLOC_TRACE("\tmalloc: Nothing in the free list fits. Reserving from the top chunk...\n");
+
+    // Reserve all of the top chunk, then split off what we don't need. freeImpl makes the
+    // remainder (being the last block) the new top chunk.
+    Header* block = top;
+    top = NULL;
+    block->free = false;
+    getFooter(block)->free = false;
+    trySplitBlock(block, size);
+    prefaultThrough(block);
+    return block;
+}
+
+template <class Policies>
+void* BasicSchurmalloc<Policies>::reallocImpl(void* ptr, std::size_t newSize)
+{
+    if (ptr == NULL)
+    {
+        return mallocImpl(newSize);
+    }
+    if (newSize == 0)
+    {
+        freeImpl(ptr);
+        return NULL;
+    }
+    newSize = alignSize(newSize);
+
+    Header* block = getHeader(ptr);
+
+    if (newSize < block->size)
+    {
+        SCHURMALLOC_TRACE("\trealloc: Shrinking block...\n");
+        // Split block into a reserved block of newSize and a free block of size - newSize.
+        // The reserved block stays where it is, so don't touch ptr.
+        bool split = trySplitBlock(block, newSize);
+
+        // Sanity checks...
+        if (split)
+        {
+            SCHURMALLOC_TRACE("\trealloc: We've split the block in order to shrink\n");
+            SCHURMALLOC_CHECK(block->size == newSize);
+        }
+        else
+        {
+            SCHURMALLOC_TRACE("\trealloc: Actually didn't shrink block, because the remainder would be too small\n");
+            // If split didn't happen, it's because diff between size and newSize isn't enough for
+            // metadata plus the split policy's minimum payload.
+            SCHURMALLOC_CHECK(block->size - newSize < sizeof(Header) + sizeof(Footer) + Policies::Split::minPayload);
+            SCHURMALLOC_CHECK(block->size > newSize);
+        }
+    }
+    else if (newSize > block->size)
+    {
+        SCHURMALLOC_TRACE("\trealloc: Expanding block...\n");
+        if (top && // Can we expand block into the top chunk?
+            getNextHeader(block) == top &&
+            block->size + sizeof(Footer) + sizeof(Header) + top->size >= newSize)
+        {
+            // The top chunk isn't in the free list, so growing into it doesn't touch the list.
+            SCHURMALLOC_TRACE("\trealloc: Expanding block into the top chunk...\n");
+            Footer* topFooter = getFooter(top);
+            size_t availableSize = block->size + sizeof(Footer) + sizeof(Header) + top->size;
+            if (availableSize < newSize + sizeof(Footer) + sizeof(Header) + Policies::Split::minPayload)
+            {
+                // Too little would be left of the top chunk, so swallow it whole.
+                top = NULL;
+                block->size = availableSize;
+                SCHURMALLOC_CHECK(getFooter(block) == topFooter);
+                topFooter->size = availableSize;
+                topFooter->free = false;
+            }
+            else
+            {
+                block->size = newSize;
+                getFooter(block)->size = newSize;
+                getFooter(block)->free = false;
+                top = getNextHeader(block);
+                top->size = availableSize - newSize - sizeof(Footer) - sizeof(Header);
+                top->free = true;
+                top->prev = NULL;
+                top->next = NULL;
+                SCHURMALLOC_CHECK(getFooter(top) == topFooter);
+                topFooter->size = top->size;
+            }
+        }
+        else if (!isLastBlock(getFooter(block)) && // Can we expand block into the following block?
+            getNextHeader(block)->free &&
+            block->size + sizeof(Footer) + sizeof(Header) + getNextHeader(block)->size >= newSize)
+        {
+            // Expand block into following block
+            SCHURMALLOC_TRACE("\trealloc: Expanding block into the following block...\n");
+            Header* freeHeader = getNextHeader(block);
+            Footer* freeFooter = getFooter(freeHeader);
+            SCHURMALLOC_CHECK(freeHeader->free);
+            SCHURMALLOC_CHECK(freeFooter->free);
+            SCHURMALLOC_CHECK(freeHeader->size == freeFooter->size);
+            size_t availableSize = block->size + sizeof(Footer) + sizeof(Header) + freeHeader->size;
+            if (availableSize < newSize + sizeof(Footer) + sizeof(Header) + Policies::Split::minPayload)
+            {
+                // Whatever would be left of the subsequent block is too small to stay a block of its
+                // own (usually because we need exactly all of it), so we swallow it whole.
+                // This means that the subsequent block needs to be taken out of the free list, and
+                // the footer of the subsequent block will become our new footer.
+                reserve(freeHeader);
+                block->size = availableSize;
+                SCHURMALLOC_CHECK(getFooter(block) == freeFooter);
+                freeFooter->size = availableSize;
+            }
+            else
+            {
+                // The subsequent block will be shrunk, but it will maintain its place in the free list.
+                SCHURMALLOC_CHECK(availableSize > newSize);
+                size_t remainderSize = freeHeader->size - (newSize - block->size);
+                Header* prev = freeHeader->prev;
+                Header* next = freeHeader->next;
+                freeFooter->size = remainderSize;
+                SCHURMALLOC_CHECK(getHeader(freeFooter) == reinterpret_cast<Header*>(reinterpret_cast<char*>(freeHeader) + (newSize - block->size)));
+                getHeader(freeFooter)->size = remainderSize;
+                getHeader(freeFooter)->free = true;
+                getHeader(freeFooter)->prev = prev;
+                getHeader(freeFooter)->next = next;
+                if (prev)
+                {
+                    prev->next = getHeader(freeFooter);
+                }
+                else
+                {
+                    freeList = getHeader(freeFooter);
+                }
+                if (next)
+                {
+                    next->prev = getHeader(freeFooter);
+                }
+                
+                block->size = newSize;
+                SCHURMALLOC_CHECK(getFooter(block) == getPrevFooter(getHeader(freeFooter)));
+                getFooter(block)->size = newSize;
+                getFooter(block)->free = false;
+            }
+        }
+        else if (!isFirstBlock(block) && // Can we expand block into the preceding block?
+                 getPrevFooter(block)->free &&
+                 getPrevFooter(block)->size + sizeof(Footer) + sizeof(Header) + block->size >= newSize)
+        {
+            // Expand block into preceding block
+            SCHURMALLOC_TRACE("\trealloc: Expanding block into preceding block...\n");
+            Header* prevHeader = getPrevHeader(block);
+            Footer* prevFooter = getFooter(prevHeader);
+            Footer* blockFooter = getFooter(block);
+            SCHURMALLOC_CHECK(prevHeader->free);
+            SCHURMALLOC_CHECK(prevFooter->free);
+            SCHURMALLOC_CHECK(prevHeader->size == prevFooter->size);
+            SCHURMALLOC_CHECK(!blockFooter->free);
+            SCHURMALLOC_CHECK(block->size == blockFooter->size);
+            size_t availableSize = prevHeader->size + sizeof(Footer) + sizeof(Header) + block->size;
+            if (availableSize < newSize + sizeof(Footer) + sizeof(Header) + Policies::Split::minPayload)
+            {
+                // Whatever would be left of the preceding block is too small to stay a block of its
+                // own (usually because we need exactly all of it), so we swallow it whole.
+                // This means that the preceding block needs to be taken out of the free list, and
+                // the header of the preceding block becomes our new header.
+                reserve(prevHeader);
+                prevHeader->size = availableSize;
+                SCHURMALLOC_CHECK(getFooter(prevHeader) == blockFooter);
+                getFooter(prevHeader)->size = availableSize;
+                std::memmove(getPayload(prevHeader), ptr, block->size);
+                ptr = getPayload(prevHeader);
+            }
+            else
+            {
+                // The preceding block will be shrunk, but it will maintain its place in the free list.
+                SCHURMALLOC_CHECK(availableSize > newSize);
+                size_t remainderSize = prevHeader->size - (newSize - block->size);
+                // The new header can overlap the old one, so remember how much data there is to move.
+                size_t oldSize = block->size;
+
+                prevHeader->size = remainderSize;
+                getFooter(prevHeader)->size = remainderSize;
+                getFooter(prevHeader)->free = true;
+                
+                blockFooter->size = newSize;
+                getHeader(blockFooter)->size = newSize;
+                getHeader(blockFooter)->free = false;
+                getHeader(blockFooter)->prev = NULL;
+                getHeader(blockFooter)->next = NULL;
+
+                std::memmove(getPayload(getHeader(blockFooter)), ptr, oldSize);
+                ptr = getPayload(getHeader(blockFooter));
+            }
+        }
+        else
+        {
+            // We need to try to malloc a new block, since we can't expand in place.
+            SCHURMALLOC_TRACE("\trealloc: Can't expand in place. Need to malloc new block\n");
+            ptr = mallocImpl(newSize);
+            if (ptr)
+            {
+                // Copy the old block's data into the new one.
+                // (We can use memcpy because we know for sure the blocks don't overlap.)
+                std::memcpy(ptr, getPayload(block), block->size);
+
+                // Now that we're done with the old block, free it.
+                freeImpl(getPayload(block));
+            }
+        }
+    }
+    // Do nothing to the block if newSize == block->size
+
+    // Sanity checks...
+    if (ptr)
+    {
+        Header* b = getHeader(ptr);
+        SCHURMALLOC_CHECK(b->size >= newSize);
+        SCHURMALLOC_CHECK(b->size == getFooter(b)->size);
+        SCHURMALLOC_CHECK(!b->free);
+        SCHURMALLOC_CHECK(!getFooter(b)->free);
+
+        // Growing in place can move the end of the block past the frontier.
+        prefaultThrough(b);
+    }
+    return ptr;
+}
+
+template <class Policies>
+void BasicSchurmalloc<Policies>::freeImpl(void* ptr)
+{
+    Header* block = getHeader(ptr);
+    Footer* footer = getFooter(block);
+
+    // Sanity checks...
+    SCHURMALLOC_CHECK(!block->free);
+    SCHURMALLOC_CHECK(!footer->free);
+    SCHURMALLOC_CHECK(block->size == footer->size);
+
+    block->free = true;
+    footer->free = true;
+
+    if constexpr (Policies::wilderness)
+    {
+        if (isLastBlock(footer) || getNextHeader(footer) == top)
+        {
+            // The block joins the top chunk (or becomes it), which stays out of the free list.
+            SCHURMALLOC_TRACE("\tfree: Merging block-to-free into the top chunk.\n");
+            if (top)
+            {
+                block->size += sizeof(Footer) + sizeof(Header) + top->size;
+                getFooter(block)->size = block->size;
+            }
+            if (!isFirstBlock(block) && getPrevFooter(block)->free)
+            {
+                // A free block before it leaves the free list to join the top chunk too.
+                Header* prev = getPrevHeader(block);
+                unlink(prev);
+                prev->size += sizeof(Footer) + sizeof(Header) + block->size;
+                getFooter(prev)->size = prev->size;
+                block = prev;
+            }
+            block->prev = NULL;
+            block->next = NULL;
+            top = block;
+            return;
+        }
+    }
+
+    // Insert this new free block into the free list
+    if (freeList == NULL) // block is the only free block
+    {
+        SCHURMALLOC_TRACE("\tfree: Freelist is NULL, so making block-to-free the only free block.\n");
+        freeList = block;
+        block->prev = NULL;
+        block->next = NULL;
+        return; // quit before coalescing, because we know there's no other blocks to coalesce with
+    }
+    else if (block < freeList) // block is to be the first element in the free list
+    {
+        SCHURMALLOC_TRACE("\tfree: Block to free is prior to other free blocks.\n");
+        block->prev = NULL;
+        block->next = freeList;
+        freeList->prev = block;
+        freeList = block;
+    }
+    else // traverse the free list to find where block belongs
+    {
+        SCHURMALLOC_TRACE("\tfree: Traversing freelist to find where to put block-to-free.\n");
+        Header* prev = NULL;
+        Header* next = freeList;
+        while (next && block > next)
+        {
+            prev = next;
+            next = next->next;
+        }
+        prev->next = block;
+        block->prev = prev;
+        block->next = next;
+        if (next) next->prev = block;
+    }
+
+    // See if we can coalesce with the previous block
+    if (!isFirstBlock(block) && // If this is the first block, don't look at prev block!
+        getPrevFooter(block)->free)
+    {
+        SCHURMALLOC_TRACE("\tfree: Coalescing newly freed block with previous block...\n");
+        block = coalesce(getPrevHeader(block), block);
+    }
+
+    // See if we can coalesce with the next block
+    if (!isLastBlock(footer) &&
+        getNextHeader(footer)->free)
+    {
+        SCHURMALLOC_TRACE("\tfree: Coalescing newly freed block with subsequent block...\n");
+        block = coalesce(block, getNextHeader(block));
+    }
+}
+
+template <class Policies>
+bool BasicSchurmalloc<Policies>::trySplitBlock(Header* block, std::size_t size)
+{
+    // Sanity checks...
+    SCHURMALLOC_CHECK(block);
+    SCHURMALLOC_CHECK(block->size == getFooter(block)->size);
+    SCHURMALLOC_CHECK(block->free == getFooter(block)->free);
+
+    /* When the block is split, this will be what happens:
+    |------------------------------------------------------------------------|
+    | Header |                     block->size bytes                | Footer | ==> 
+    |------------------------------------------------------------------------|
+
+    |------------------------------------------------------------------------|
+    | Header | size bytes | NewFooter | NewHeader | remainder bytes | Footer |
+    |------------------------------------------------------------------------| */
+
+    // Make sure there's enough remainder bytes for us to be able to split.
+    // (Do this check before calculating remainder, because size_t is unsigned, which could lead to
+    // some underflow funkiness if, e.g., block->size == size.)
+    if (size + sizeof(Footer) + sizeof(Header) + Policies::Split::minPayload > block->size)
+    {
+        // The residual block isn't large enough for both metadata and the split policy's minimum payload.
+        return false;
+    }
+    std::size_t remainder = block->size - size - sizeof(Footer) - sizeof(Header);
+
+    Header* remainderHeader = reinterpret_cast<Header*>(reinterpret_cast<char*>(block) +
+                                                        sizeof(Header) +
+                                                        size +
+                                                        sizeof(Footer));
+    Footer* remainderFooter = getFooter(block);
+    Footer* thisFooter = reinterpret_cast<Footer*>(reinterpret_cast<char*>(block) +
+                                                   sizeof(Header) +
+                                                   size);
+    remainderHeader->size = remainder;
+    remainderFooter->size = remainder;
+    block->size = size;
+    thisFooter->size = size;
+    thisFooter->free = block->free;
+
+    if (block->free)
+    {
+        remainderHeader->free = true;
+        remainderFooter->free = true;
+        remainderHeader->prev = block;
+        remainderHeader->next = block->next;
+        if (remainderHeader->next)
+        {
+            remainderHeader->next->prev = remainderHeader;
+        }
+        block->next = remainderHeader;
+
+        // Sanity checks...
+        SCHURMALLOC_CHECK(block->next == getNextHeader(block));
+        SCHURMALLOC_CHECK(getNextHeader(block)->prev == block);
+    }
+    else // Block isn't free, but the remainder will be made free
+    {
+        remainderHeader->free = false;
+        remainderFooter->free = false;
+        remainderHeader->prev = NULL;
+        remainderHeader->next = NULL;
+        freeImpl(getPayload(remainderHeader));
+    }
+
+    // Sanity checks...
+    SCHURMALLOC_CHECK(block->size == getFooter(block)->size);
+    SCHURMALLOC_CHECK(block->free == getFooter(block)->free);
+    SCHURMALLOC_CHECK(getNextHeader(block)->size == getFooter(getNextHeader(block))->size);
+    SCHURMALLOC_CHECK(getNextHeader(block)->free);
+    SCHURMALLOC_CHECK(getFooter(getNextHeader(block))->free);
+
+    return true;
+}
+
+template <class Policies>
+typename BasicSchurmalloc<Policies>::Header* BasicSchurmalloc<Policies>::coalesce(Header* first, Header* second)
+{
+    // Sanity checks...
+    Footer* firstFooter = getFooter(first);
+    Footer* secondFooter = getFooter(second);
+    SCHURMALLOC_CHECK(first->free);
+    SCHURMALLOC_CHECK(firstFooter->free);
+    SCHURMALLOC_CHECK(second->free);
+    SCHURMALLOC_CHECK(secondFooter->free);
+    SCHURMALLOC_CHECK(first->size == firstFooter->size);
+    SCHURMALLOC_CHECK(second->size == secondFooter->size);
+    SCHURMALLOC_CHECK(first->next == second);
+    SCHURMALLOC_CHECK(second->prev == first);
+    SCHURMALLOC_CHECK(getNextHeader(first) == second);
+
+    /* When the blocks are coalesced, this is what will happen:
+    |---------------------------------------------------------|
+    | Header1 | Block1 | Footer1 | Header2 | Block2 | Footer2 | ==>
+    |---------------------------------------------------------|
+
+    |---------------------------------------------------------|
+    | Header1 |                Block                | Footer2 |
+    |---------------------------------------------------------| */
+
+    first->size += sizeof(Footer) + sizeof(Header) + second->size;
+    secondFooter->size = first->size;
+    first->next = second->next;
+
+    if (first->next)
+    {
+        first->next->prev = first;
+    }
+
+    // Sanity checks...
+    SCHURMALLOC_CHECK(first->size == getFooter(first)->size);
+    SCHURMALLOC_CHECK(first->free);
+    SCHURMALLOC_CHECK(getFooter(first)->free);
+
+    return first;
+}
+
+#undef SCHURMALLOC_CHECK
+#undef SCHURMALLOC_TRACE
+#undef SCHURMALLOC_CALLER
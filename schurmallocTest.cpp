@@ -1,14 +1,43 @@
 #include "schurmalloc.h"
+#include "persistentHeap.h"
+#include "slotPool.h"
+#include "maintenanceThread.h"
+#include "heapProfiler.h"
+#include "hugePageRegion.h"
+#include "lifetimeHeap.h"
+#include "subHeap.h"
+#include "prefaulter.h"
 #include <iostream>
+#include <algorithm>
 #include <cstddef>
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <sstream>
 
 using std::cout;
 using std::vector;
 
+template <> void BasicSchurmalloc<DefaultPolicies>::testPersistence();
+template <> void BasicSchurmalloc<DefaultPolicies>::testPolicies();
+template <> void BasicSchurmalloc<DefaultPolicies>::testSlotPool();
+template <> void BasicSchurmalloc<DefaultPolicies>::testMaintenance();
+template <> void BasicSchurmalloc<DefaultPolicies>::testWilderness();
+template <> void BasicSchurmalloc<DefaultPolicies>::testProfiler();
+template <> void BasicSchurmalloc<DefaultPolicies>::testHugePages();
+template <> void BasicSchurmalloc<DefaultPolicies>::testLifetimes();
+template <> void BasicSchurmalloc<DefaultPolicies>::testSubHeaps();
+template <> void BasicSchurmalloc<DefaultPolicies>::testIsolation();
+template <> void BasicSchurmalloc<DefaultPolicies>::testPrefault();
+
 // Run a suite of tests. A fair bit of sanity checking happens in assertions in Schurmalloc.
-void Schurmalloc::test()
+template <>
+void BasicSchurmalloc<DefaultPolicies>::test()
 {
     const size_t h = sizeof(Schurmalloc::Header);
     const size_t f = sizeof(Schurmalloc::Footer);
@@ -292,12 +321,900 @@ void Schurmalloc::test()
                         vector<size_t> {rem});
 
     mem.clear();
+    std::free(memory);
+
+    cout << "\nOn a heap of exactly 100 + 150 bytes of payload, malloc(100), malloc(150), and free the first\n";
+    memory = std::malloc(250 + 2*meta);
+    {
+        Schurmalloc tight(memory, 250 + 2*meta);
+        ptr = tight.malloc(100);
+        ptr2 = tight.malloc(150);
+        assert(ptr && ptr2);
+        c = static_cast<unsigned char*>(ptr2);
+        for (unsigned char i = 0; i < 150; i++)
+        {
+            c[i] = i;
+        }
+        tight.free(ptr);
+        tight.verifyMemory(vector<TB> {TB(true,100), TB(false,150)},
+                           vector<size_t> {100});
+
+        cout << "realloc(last block, 180) expands into the preceding block, copying only the old 150 bytes\n";
+        ptr = tight.realloc(ptr2, 180);
+        assert(ptr && ptr < ptr2);
+        tight.verifyMemory(vector<TB> {TB(true,70), TB(false,180)},
+                           vector<size_t> {70});
+        c = static_cast<unsigned char*>(ptr);
+        for (unsigned char i = 0; i < 150; i++)
+        {
+            assert(c[i] == i);
+        }
+        tight.free(ptr);
+    }
+    std::free(memory);
+
+    testPersistence();
+    testPolicies();
+    testSlotPool();
+    testMaintenance();
+    testWilderness();
+    testProfiler();
+    testHugePages();
+    testLifetimes();
+    testSubHeaps();
+    testIsolation();
+    testPrefault();
 
     cout << "\nDone with Schurmalloc tests!\n";
+}
+
+template <>
+void BasicSchurmalloc<DefaultPolicies>::testPersistence()
+{
+    const size_t meta = sizeof(Schurmalloc::Header) + sizeof(Schurmalloc::Footer);
+    const size_t sb = Schurmalloc::superblockSpace;
+
+    size_t m = 1000;
+    size_t rem = m-sb-meta;
+    cout << "\nFormatting a persistent heap of " << m << " bytes...\n";
+    void* memory = std::malloc(m);
+    std::memset(memory, 0, m);
+    void* ptr; void* ptr2;
+    {
+        Schurmalloc schurm(memory, m, Persistence::Persistent);
+        assert(schurm.getOpenState() == OpenState::Formatted);
+        assert(schurm.getRoot() == NULL);
+        schurm.verifyMemory(vector<TB> {TB(true, rem)},
+                            vector<size_t> {rem});
+
+        cout << "malloc(100) and malloc(50), make the first the root, then free the second\n";
+        ptr = schurm.malloc(100);
+        std::strcpy(static_cast<char*>(ptr), "persistent root");
+        schurm.setRoot(ptr);
+        ptr2 = schurm.malloc(50);
+        schurm.free(ptr2);
+        rem -= 100+meta;
+        schurm.verifyMemory(vector<TB> {TB(false, 100), TB(true, rem)},
+                            vector<size_t> {rem});
+        schurm.shutdown();
+    }
+
+    cout << "Reattach after a clean shutdown\n";
+    {
+        Schurmalloc schurm(memory, m, Persistence::Persistent);
+        assert(schurm.getOpenState() == OpenState::Attached);
+        assert(schurm.getRoot() == ptr);
+        assert(std::strcmp(static_cast<char*>(schurm.getRoot()), "persistent root") == 0);
+        schurm.verifyMemory(vector<TB> {TB(false, 100), TB(true, rem)},
+                            vector<size_t> {rem});
+        schurm.shutdown();
+    }
+
+    cout << "Reattach at a different address, so the free list has to be relocated\n";
+    void* moved = std::malloc(m);
+    std::memcpy(moved, memory, m);
+    assert(getPreferredAddress(moved, m) == memory);
+    {
+        Schurmalloc schurm(moved, m, Persistence::Persistent);
+        assert(schurm.getOpenState() == OpenState::Attached);
+        assert(std::strcmp(static_cast<char*>(schurm.getRoot()), "persistent root") == 0);
+        schurm.verifyMemory(vector<TB> {TB(false, 100), TB(true, rem)},
+                            vector<size_t> {rem});
+        ptr = schurm.malloc(rem);
+        assert(ptr);
+        schurm.verifyMemory(vector<TB> {TB(false, 100), TB(false, rem)},
+                            vector<size_t> {});
+        schurm.free(ptr);
+        schurm.verifyMemory(vector<TB> {TB(false, 100), TB(true, rem)},
+                            vector<size_t> {rem});
+        // No shutdown, as if we crashed
+    }
+    std::free(moved);
+
+    cout << "Reattach without a clean shutdown, after a crash left two free blocks uncoalesced\n";
+    {
+        Schurmalloc schurm(memory, m, Persistence::Persistent);
+        assert(schurm.getOpenState() == OpenState::Attached);
+        ptr = schurm.malloc(200);
+        ptr2 = schurm.malloc(200);
+        rem -= 400+2*meta;
+        schurm.verifyMemory(vector<TB> {TB(false, 100), TB(false, 200), TB(false, 200), TB(true, rem)},
+                            vector<size_t> {rem});
+        // Simulate a crash in free() after the tags were marked free, but before coalescing
+        Header* h = getHeader(ptr2);
+        h->free = true;
+        getFooter(h)->free = true;
+        h->prev = reinterpret_cast<Header*>(0xdeadbeef);
+    }
+    {
+        Schurmalloc schurm(memory, m, Persistence::Persistent);
+        assert(schurm.getOpenState() == OpenState::Recovered);
+        rem += 200+meta;
+        schurm.verifyMemory(vector<TB> {TB(false, 100), TB(false, 200), TB(true, rem)},
+                            vector<size_t> {rem});
+
+        cout << "Corrupt the tags of the free block, then recover again\n";
+        getHeader(ptr2)->size = 12345;
+    }
+    {
+        Schurmalloc schurm(memory, m, Persistence::Persistent);
+        assert(schurm.getOpenState() == OpenState::Recovered);
+        schurm.verifyMemory(vector<TB> {TB(false, 100), TB(false, 200), TB(false, rem)},
+                            vector<size_t> {});
+        assert(schurm.malloc(1) == NULL);
+        schurm.shutdown();
+    }
+    std::free(memory);
+
+    cout << "Create a file-backed heap, then reopen it\n";
+    const char* path = "schurmallocTest.heap";
+    std::remove(path);
+    {
+        PersistentHeap file(path, 4096);
+        Schurmalloc* schurm = file.heap();
+        assert(schurm);
+        assert(schurm->getOpenState() == OpenState::Formatted);
+        ptr = schurm->malloc(64);
+        std::strcpy(static_cast<char*>(ptr), "survives restarts");
+        schurm->setRoot(ptr);
+    }
+    {
+        PersistentHeap file(path, 0);
+        Schurmalloc* schurm = file.heap();
+        assert(schurm);
+        assert(schurm->getOpenState() == OpenState::Attached);
+        assert(std::strcmp(static_cast<char*>(schurm->getRoot()), "survives restarts") == 0);
+        schurm->free(schurm->getRoot());
+        schurm->setRoot(NULL);
+    }
+    std::remove(path);
+}
+
+// Best fit, 8-byte alignment, and a larger minimum split, with stats and locking on and tracing off
+struct TestPolicies : DefaultPolicies
+{
+    using Fit = BestFit;
+    using Split = MinRemainderSplit<16>;
+    static constexpr std::size_t alignment = 8;
+    using Stats = CountingStats;
+    using Lock = std::mutex;
+    static constexpr bool trace = false;
+};
+
+template <>
+void BasicSchurmalloc<DefaultPolicies>::testPolicies()
+{
+    using Custom = BasicSchurmalloc<TestPolicies>;
+    using CTB = Custom::TB;
+    const size_t meta = sizeof(Custom::Header) + sizeof(Custom::Footer);
+
+    size_t m = 1000;
+    size_t rem = m-meta;
+    cout << "\nTesting custom policies on " << m << " bytes...\n";
+    void* memory = std::malloc(m);
+    Custom schurm(memory, m);
+
+    cout << "malloc 100, 8, 40 and 8 (100 rounds up to 104)\n";
+    void* a = schurm.malloc(100);
+    void* b = schurm.malloc(8);
+    void* c = schurm.malloc(40);
+    void* d = schurm.malloc(8);
+    rem -= 104+8+40+8 + 4*meta;
+    schurm.verifyMemory(vector<CTB> {CTB(false,104), CTB(false,8), CTB(false,40), CTB(false,8), CTB(true,rem)},
+                        vector<size_t> {rem});
+
+    cout << "free the 104 and 40 blocks\n";
+    schurm.free(a);
+    schurm.free(c);
+    schurm.verifyMemory(vector<CTB> {CTB(true,104), CTB(false,8), CTB(true,40), CTB(false,8), CTB(true,rem)},
+                        vector<size_t> {104, 40, rem});
+
+    cout << "malloc(33) should take the best fit (the 40 block), not the first fit\n";
+    void* ptr = schurm.malloc(33);
+    assert(ptr == c);
+    schurm.verifyMemory(vector<CTB> {CTB(true,104), CTB(false,8), CTB(false,40), CTB(false,8), CTB(true,rem)},
+                        vector<size_t> {104, rem});
+
+    cout << "malloc(90) takes the whole 104 block, since the remainder is below the minimum split\n";
+    ptr = schurm.malloc(90);
+    assert(ptr == a);
+    schurm.verifyMemory(vector<CTB> {CTB(false,104), CTB(false,8), CTB(false,40), CTB(false,8), CTB(true,rem)},
+                        vector<size_t> {rem});
+
+    assert(schurm.getStats().mallocs == 6);
+    assert(schurm.getStats().frees == 2);
+    assert(schurm.getStats().bytesInUse == 104+8+40+8);
+    assert(schurm.getStats().peakBytesInUse == 104+8+40+8);
+
+    cout << "realloc(b, 20) has to move, and rounds up to 24\n";
+    ptr = schurm.realloc(b, 20);
+    assert(ptr > d);
+    assert(reinterpret_cast<std::uintptr_t>(ptr) % 8 == 0);
+    rem -= 24 + meta;
+    schurm.verifyMemory(vector<CTB> {CTB(false,104), CTB(true,8), CTB(false,40), CTB(false,8), CTB(false,24), CTB(true,rem)},
+                        vector<size_t> {8, rem});
+    assert(schurm.getStats().reallocs == 1);
+    assert(schurm.getStats().bytesInUse == 104+40+8+24);
+
+    cout << "free everything\n";
+    schurm.free(a);
+    schurm.free(c);
+    schurm.free(d);
+    schurm.free(ptr);
+    schurm.verifyMemory(vector<CTB> {CTB(true,m-meta)},
+                        vector<size_t> {m-meta});
+    assert(schurm.getStats().bytesInUse == 0);
+    assert(schurm.getStats().peakBytesInUse == 104+40+8+24);
+
+    cout << "realloc(NULL, 16) counts as a malloc, and realloc(ptr, 0) as a free\n";
+    ptr = schurm.realloc(NULL, 16);
+    assert(ptr);
+    assert(schurm.getStats().mallocs == 7);
+    assert(schurm.getStats().reallocs == 1);
+    assert(schurm.getStats().bytesInUse == 16);
+    assert(schurm.realloc(ptr, 0) == NULL);
+    assert(schurm.getStats().mallocs - schurm.getStats().frees == 0);
+    assert(schurm.getStats().bytesInUse == 0);
+
+    std::free(memory);
+}
+
+template <>
+void BasicSchurmalloc<DefaultPolicies>::testSlotPool()
+{
+    const size_t meta = sizeof(Schurmalloc::Header) + sizeof(Schurmalloc::Footer);
+    size_t m = 20000;
+    cout << "\nTesting a slot pool on a heap of " << m << " bytes...\n";
+    void* memory = std::malloc(m);
+    Schurmalloc schurm(memory, m);
+
+    {
+        SlotPool pool(schurm, 24, 100);
+        std::set<void*> slots;
+
+        cout << "malloc 100 slots, which fills the first run\n";
+        for (int i = 0; i < 100; i++)
+        {
+            void* slot = pool.malloc();
+            assert(slot);
+            assert(pool.contains(slot));
+            assert(slots.insert(slot).second);
+        }
+        char* first = static_cast<char*>(*slots.begin());
+        assert(static_cast<char*>(*slots.rbegin()) == first + 99*24);
+
+        cout << "free slots 70 and 5, then malloc gets the lowest one back first\n";
+        pool.free(first + 70*24);
+        pool.free(first + 5*24);
+        assert(pool.malloc() == first + 5*24);
+        assert(pool.malloc() == first + 70*24);
+
+        cout << "malloc one more slot, which needs a second run\n";
+        void* extra = pool.malloc();
+        assert(extra);
+        assert(!slots.count(extra));
+        assert(extra < first || extra > first + 99*24);
+        slots.insert(extra);
+
+        cout << "mallocBulk(150) fills the second run and spills into a third\n";
+        vector<void*> bulk(150);
+        assert(pool.mallocBulk(bulk.data(), 150) == 150);
+        for (void* slot : bulk)
+        {
+            assert(pool.contains(slot));
+            assert(slots.insert(slot).second);
+        }
+        assert(slots.size() == 251);
+        assert(!pool.contains(memory));
+
+        cout << "free everything, and trim the empty runs\n";
+        for (void* slot : slots)
+        {
+            pool.free(slot);
+        }
+        pool.trim();
+        assert(!pool.contains(first));
+    }
+
+    cout << "Destroying the pool returns everything to the heap\n";
+    schurm.verifyMemory(vector<TB> {TB(true, m-meta)},
+                        vector<size_t> {m-meta});
+    std::free(memory);
+}
+
+// Locking, so the heap can be shared with a maintenance thread, and no tracing from it
+struct ThreadedPolicies : DefaultPolicies
+{
+    using Lock = std::mutex;
+    static constexpr bool trace = false;
+};
+
+template <>
+void BasicSchurmalloc<DefaultPolicies>::testMaintenance()
+{
+    using Threaded = BasicSchurmalloc<ThreadedPolicies>;
+    using TTB = Threaded::TB;
+    const size_t meta = sizeof(Threaded::Header) + sizeof(Threaded::Footer);
+    size_t m = 100000;
+    cout << "\nTesting a maintenance thread on a heap of " << m << " bytes...\n";
+    void* memory = std::malloc(m);
+    Threaded schurm(memory, m);
+
+    {
+        BasicMaintenanceThread<ThreadedPolicies> maintenance(schurm, 64, 16);
+
+        cout << "4 threads malloc and free through the maintenance thread\n";
+        vector<std::thread> threads;
+        for (int t = 0; t < 4; t++)
+        {
+            threads.emplace_back([&maintenance, t] {
+                vector<void*> blocks;
+                for (int i = 0; i < 2000; i++)
+                {
+                    void* ptr = maintenance.malloc(16 + (i*7 + t) % 200);
+                    assert(ptr);
+                    blocks.push_back(ptr);
+                    if (blocks.size() > 20)
+                    {
+                        maintenance.free(blocks.front());
+                        blocks.erase(blocks.begin());
+                    }
+                }
+                for (void* ptr : blocks)
+                {
+                    maintenance.free(ptr);
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+        maintenance.flush();
+        schurm.verifyMemory(vector<TTB> {TTB(true, m-meta)},
+                            vector<size_t> {m-meta});
+        cout << "(" << maintenance.getSynchronousFrees() << " frees fell back to being synchronous)\n";
+
+        cout << "Fill the heap, free it all, then malloc everything again straight away\n";
+        vector<void*> blocks;
+        for (int i = 0; i < 10; i++)
+        {
+            blocks.push_back(maintenance.malloc((m - 10*meta) / 10));
+            assert(blocks.back());
+        }
+        for (void* ptr : blocks)
+        {
+            maintenance.free(ptr);
+        }
+        void* ptr = maintenance.malloc(m - meta);
+        assert(ptr);
+        maintenance.free(ptr);
+
+        cout << "Fewer frees than a batch wait for flush, which wakes the worker for them\n";
+        maintenance.flush();
+        blocks.clear();
+        for (int i = 0; i < 3; i++)
+        {
+            blocks.push_back(maintenance.malloc(100));
+        }
+        for (void* block : blocks)
+        {
+            maintenance.free(block);
+        }
+        maintenance.flush();
+        schurm.verifyMemory(vector<TTB> {TTB(true, m-meta)},
+                            vector<size_t> {m-meta});
+    }
+
+    cout << "Destroying the maintenance thread finishes its queued frees\n";
+    schurm.verifyMemory(vector<TTB> {TTB(true, m-meta)},
+                        vector<size_t> {m-meta});
+    std::free(memory);
+}
+
+struct WildernessPolicies : DefaultPolicies
+{
+    static constexpr bool wilderness = true;
+    static constexpr bool trace = false;
+};
+
+template <>
+void BasicSchurmalloc<DefaultPolicies>::testWilderness()
+{
+    using Wild = BasicSchurmalloc<WildernessPolicies>;
+    using WTB = Wild::TB;
+    const size_t meta = sizeof(Wild::Header) + sizeof(Wild::Footer);
+    size_t m = 2000;
+    cout << "\nTesting the wilderness policy on a persistent heap of " << m << " bytes...\n";
+    void* memory = std::malloc(m);
+    std::memset(memory, 0, m);
+    size_t rem = m - Wild::superblockSpace - meta;
+
+    {
+        Wild schurm(memory, m, Wild::Persistence::Persistent);
+        cout << "All of memory is the top chunk, which isn't in the free list\n";
+        schurm.verifyMemory(vector<WTB> {WTB(true, rem)},
+                            vector<size_t> {});
+        assert(schurm.top);
+
+        cout << "malloc 200 three times, then free the middle one\n";
+        void* a = schurm.malloc(200);
+        void* b = schurm.malloc(200);
+        void* c = schurm.malloc(200);
+        rem -= 600 + 3*meta;
+        schurm.free(b);
+        schurm.verifyMemory(vector<WTB> {WTB(false, 200), WTB(true, 200), WTB(false, 200), WTB(true, rem)},
+                            vector<size_t> {200});
+
+        cout << "malloc(500) doesn't fit in the free list, so it comes from the top chunk\n";
+        void* d = schurm.malloc(500);
+        assert(d > c);
+        rem -= 500 + meta;
+        schurm.verifyMemory(vector<WTB> {WTB(false, 200), WTB(true, 200), WTB(false, 200), WTB(false, 500), WTB(true, rem)},
+                            vector<size_t> {200});
+
+        cout << "realloc(d, 600) grows into the top chunk without touching the free list\n";
+        assert(schurm.realloc(d, 600) == d);
+        rem -= 100;
+        schurm.verifyMemory(vector<WTB> {WTB(false, 200), WTB(true, 200), WTB(false, 200), WTB(false, 600), WTB(true, rem)},
+                            vector<size_t> {200});
+
+        cout << "free c, then d. d merges into the top chunk, pulling c out of the free list with it\n";
+        schurm.free(c);
+        schurm.verifyMemory(vector<WTB> {WTB(false, 200), WTB(true, 400 + meta), WTB(false, 600), WTB(true, rem)},
+                            vector<size_t> {400 + meta});
+        schurm.free(d);
+        rem += 400 + 600 + 3*meta;
+        schurm.verifyMemory(vector<WTB> {WTB(false, 200), WTB(true, rem)},
+                            vector<size_t> {});
+
+        cout << "Shut down with a top chunk, then reattach\n";
+        schurm.setRoot(a);
+        schurm.shutdown();
+    }
+    {
+        Wild schurm(memory, m, Wild::Persistence::Persistent);
+        assert(schurm.getOpenState() == Wild::OpenState::Attached);
+        schurm.verifyMemory(vector<WTB> {WTB(false, 200), WTB(true, rem)},
+                            vector<size_t> {});
+        assert(schurm.top);
+        schurm.free(schurm.getRoot());
+        schurm.verifyMemory(vector<WTB> {WTB(true, m - Wild::superblockSpace - meta)},
+                            vector<size_t> {});
+    }
+    std::free(memory);
+}
+
+struct ProfiledPolicies : DefaultPolicies
+{
+    using Profiler = SamplingProfiler;
+    static constexpr bool trace = false;
+};
+
+template <>
+void BasicSchurmalloc<DefaultPolicies>::testProfiler()
+{
+    using Profiled = BasicSchurmalloc<ProfiledPolicies>;
+    size_t m = 100000;
+    cout << "\nTesting the sampling profiler on a heap of " << m << " bytes...\n";
+    void* memory = std::malloc(m);
+    Profiled schurm(memory, m);
+    SamplingProfiler& profiler = schurm.getProfiler();
+    profiler.setSampleInterval(1); // Sample everything, so the profile is exact
+
+    cout << "malloc(100) 10 times from one call site, and malloc(300) 5 times from another\n";
+    vector<void*> a, b;
+    for (int i = 0; i < 10; i++) a.push_back(schurm.malloc(100));
+    for (int i = 0; i < 5; i++) b.push_back(schurm.malloc(300));
+    vector<SamplingProfiler::Site> profile = profiler.getProfile();
+    assert(profile.size() == 2);
+    assert(profile[0].samples == 5);
+    assert(profile[0].sampledBytes == 1500);
+    assert(profile[1].samples == 10);
+    assert(profile[1].sampledBytes == 1000);
+    assert(profile[0].frames != profile[1].frames);
+    // The allocator's own frames are left out, so each site's stack starts at its own call.
+    assert(profile[0].frames[0] != profile[1].frames[0]);
+    assert(profile[0].estimatedBytes >= 1500);
+
+    cout << "Freeing the second site's blocks drops them from the profile\n";
+    for (void* ptr : b) schurm.free(ptr);
+    profile = profiler.getProfile();
+    assert(profile.size() == 1);
+    assert(profile[0].sampledBytes == 1000);
+
+    cout << "A realloc moves the block to the realloc's call site\n";
+    a[0] = schurm.realloc(a[0], 200);
+    profile = profiler.getProfile();
+    assert(profile.size() == 2);
+    assert(profile[0].sampledBytes == 900);
+    assert(profile[1].sampledBytes == 200);
+
+    std::ostringstream dump;
+    profiler.dump(dump);
+    assert(dump.str().find("2 call sites") != std::string::npos);
+
+    cout << "free everything, which empties the profile\n";
+    for (void* ptr : a) schurm.free(ptr);
+    assert(profiler.getProfile().empty());
+
+    cout << "With a 64 KiB interval, only a few of 1000 small mallocs get sampled\n";
+    profiler.setSampleInterval(64 << 10);
+    a.clear();
+    for (int i = 0; i < 1000; i++) a.push_back(schurm.malloc(8));
+    size_t sampled = 0;
+    for (const SamplingProfiler::Site& site : profiler.getProfile()) sampled += site.samples;
+    assert(sampled < 10);
+    for (void* ptr : a) schurm.free(ptr);
+    assert(profiler.getProfile().empty());
+
+    std::free(memory);
+}
+
+template <>
+void BasicSchurmalloc<DefaultPolicies>::testHugePages()
+{
+    const size_t meta = sizeof(Schurmalloc::Header) + sizeof(Schurmalloc::Footer);
+    const size_t hp = HugePageRegion::hugePageSize;
+    cout << "\nTesting a heap on a huge page region of 3 MiB (rounded up to 4)...\n";
+    HugePageRegion region(3 << 20, HugePageRegion::Mode::Transparent);
+    assert(region.getMemory());
+    assert(region.getSize() == 2*hp);
+    cout << "Huge pages: " << (region.getMode() == HugePageRegion::Mode::None ? "none" :
+                               region.getMode() == HugePageRegion::Mode::Transparent ? "transparent" : "explicit") << "\n";
+    assert(reinterpret_cast<std::uintptr_t>(region.getMemory()) % hp == 0);
+    size_t m = region.getSize();
+    Schurmalloc schurm(region.getMemory(), m);
+
+    {
+        SlotPool pool(schurm, 64, 64);
+        vector<void*> slots(128);
+
+        cout << "mallocBulk(128) fills two runs\n";
+        assert(pool.mallocBulk(slots.data(), 128) == 128);
+        char* low = static_cast<char*>(std::min(slots[0], slots[64]));
+        char* high = static_cast<char*>(std::max(slots[0], slots[64]));
+
+        cout << "free a slot in each run, and malloc fills the lower run first, to keep slots packed\n";
+        pool.free(high + 20*64);
+        pool.free(low + 10*64);
+        assert(pool.malloc() == low + 10*64);
+        assert(pool.malloc() == high + 20*64);
+
+        for (void* slot : slots) pool.free(slot);
+    }
+
+    schurm.verifyMemory(vector<TB> {TB(true, m-meta)},
+                        vector<size_t> {m-meta});
+}
+
+template <>
+void BasicSchurmalloc<DefaultPolicies>::testLifetimes()
+{
+    const size_t meta = sizeof(Schurmalloc::Header) + sizeof(Schurmalloc::Footer);
+    size_t m = 60000;
+    cout << "\nTesting a lifetime-segregated heap of " << m << " bytes (50% short, 30% long, 20% permanent)...\n";
+    void* memory = std::malloc(m);
+    LifetimeHeap heap(memory, m, 0.5, 0.3);
+    void* ptr;
+
+    cout << "malloc(100) with each lifetime lands in that lifetime's sub-region\n";
+    vector<void*> mem;
+    for (Lifetime lifetime : {Lifetime::Short, Lifetime::Long, Lifetime::Permanent})
+    {
+        ptr = heap.malloc(100, lifetime);
+        assert(ptr);
+        assert(heap.getLifetime(ptr) == lifetime);
+        mem.push_back(ptr);
+    }
+
+    cout << "A permanent block too big for its sub-region spills over into the long one\n";
+    ptr = heap.malloc(13000, Lifetime::Permanent);
+    assert(ptr);
+    assert(heap.getLifetime(ptr) == Lifetime::Long);
+    mem.push_back(ptr);
+    assert(heap.getPeakFootprint() >= 3*100 + 13000);
+
+    cout << "free everything\n";
+    for (void* block : mem) heap.free(block);
+    for (Lifetime lifetime : {Lifetime::Short, Lifetime::Long, Lifetime::Permanent})
+    {
+        FreeSpace space = heap.getHeap(lifetime)->getFreeSpace();
+        assert(space.blocks == 1);
+        assert(space.totalBytes == space.largestBlock);
+    }
+    assert(heap.getHeap(Lifetime::Short)->getFreeSpace().totalBytes == 30000 - meta);
+
+    cout << "With Auto, 200-byte blocks start out short. Keep 60 of them while freeing 20-byte ones right away\n";
+    heap.setPrediction(50, 1);
+    mem.clear();
+    for (int i = 0; i < 60; i++)
+    {
+        ptr = heap.malloc(200, Lifetime::Auto);
+        assert(ptr);
+        if (i == 0)
+        {
+            assert(heap.getLifetime(ptr) == Lifetime::Short);
+        }
+        mem.push_back(ptr);
+        heap.free(heap.malloc(20, Lifetime::Auto));
+    }
+
+    cout << "Now 200-byte blocks are predicted long, and 20-byte ones are still short\n";
+    ptr = heap.malloc(200, Lifetime::Auto);
+    assert(heap.getLifetime(ptr) == Lifetime::Long);
+    mem.push_back(ptr);
+    ptr = heap.malloc(20, Lifetime::Auto);
+    assert(heap.getLifetime(ptr) == Lifetime::Short);
+    mem.push_back(ptr);
+
+    for (void* block : mem) heap.free(block);
+
+    cout << "With 50% short and 50% long, there's no permanent sub-region, so permanent blocks spill into the long one\n";
+    m = 12000;
+    {
+        LifetimeHeap halves(memory, m, 0.5, 0.5);
+        assert(halves.getHeap(Lifetime::Permanent) == NULL);
+        assert(halves.getHeap(Lifetime::Short)->getFreeSpace().totalBytes == 6000 - meta);
+        assert(halves.getHeap(Lifetime::Long)->getFreeSpace().totalBytes == 6000 - meta);
+        ptr = halves.malloc(100, Lifetime::Permanent);
+        assert(ptr);
+        assert(halves.getLifetime(ptr) == Lifetime::Long);
+        halves.free(ptr);
+    }
+    std::free(memory);
+}
+
+template <>
+void BasicSchurmalloc<DefaultPolicies>::testSubHeaps()
+{
+    const size_t meta = sizeof(Schurmalloc::Header) + sizeof(Schurmalloc::Footer);
+    size_t m = 10000;
+    size_t rem = m-meta;
+    cout << "\nTesting sub-heaps on a heap of " << m << " bytes...\n";
+    void* memory = std::malloc(m);
+    Schurmalloc schurm(memory, m);
+
+    {
+        cout << "Carve out alice (3000 bytes) and bob (2000 bytes)\n";
+        SubHeap alice(schurm, "alice", 3000);
+        SubHeap bob(schurm, "bob", 2000);
+        assert(alice.isValid() && bob.isValid());
+        assert(alice.getName() == "alice");
+        rem -= 3000+meta + 2000+meta;
+        schurm.verifyMemory(vector<TB> {TB(false, 3000), TB(false, 2000), TB(true, rem)},
+                            vector<size_t> {rem});
+
+        cout << "A sub-heap too big for the parent isn't valid, and can't malloc\n";
+        SubHeap carol(schurm, "carol", m);
+        assert(!carol.isValid());
+        assert(carol.malloc(1) == NULL);
+
+        cout << "Neither is one whose quota can't hold a 1-byte block, and it takes nothing from the parent\n";
+        SubHeap dave(schurm, "dave", 16);
+        assert(!dave.isValid());
+        assert(dave.malloc(1) == NULL);
+        schurm.verifyMemory(vector<TB> {TB(false, 3000), TB(false, 2000), TB(true, rem)},
+                            vector<size_t> {rem});
+
+        cout << "malloc from both, and free finds each block's owner\n";
+        void* a = alice.malloc(100);
+        void* b = bob.malloc(100);
+        assert(SubHeap::getOwner(a) == &alice);
+        assert(SubHeap::getOwner(b) == &bob);
+        SubHeap::Usage usage = alice.getUsage();
+        assert(usage.quota == 3000);
+        assert(usage.blocks == 1);
+        assert(usage.bytesInUse >= 100);
+        SubHeap::free(a);
+        SubHeap::free(b);
+        assert(alice.getUsage().blocks == 0);
+        assert(alice.getUsage().bytesInUse == 0);
+        assert(alice.getUsage().peakBytesInUse >= 100);
+
+        cout << "A burst in alice fills alice's quota, and bob isn't affected\n";
+        size_t count = 0;
+        while (alice.malloc(50))
+        {
+            count++;
+        }
+        assert(count > 10);
+        assert(alice.getUsage().blocks == count);
+        assert(alice.getUsage().bytesInUse <= 3000);
+        b = bob.malloc(1000);
+        assert(b);
+
+        cout << "realloc stays in bob\n";
+        b = bob.realloc(b, 1500);
+        assert(b);
+        assert(SubHeap::getOwner(b) == &bob);
+        assert(bob.realloc(b, 5000) == NULL);
+
+        cout << "Destroying alice gives back its block in one go, live blocks and all\n";
+        alice.destroy();
+        assert(!alice.isValid());
+        schurm.verifyMemory(vector<TB> {TB(true, 3000), TB(false, 2000), TB(true, rem)},
+                            vector<size_t> {3000, rem});
+    }
+
+    cout << "bob is destroyed at the end of its scope, which leaves the parent empty\n";
+    schurm.verifyMemory(vector<TB> {TB(true, m-meta)},
+                        vector<size_t> {m-meta});
+    std::free(memory);
+}
+
+template <>
+void BasicSchurmalloc<DefaultPolicies>::testIsolation()
+{
+    const size_t meta = sizeof(Schurmalloc::Header) + sizeof(Schurmalloc::Footer);
+    const size_t line = DefaultPolicies::cacheLine;
+    size_t m = 4000;
+    cout << "\nTesting cache-line isolation on a heap of " << m << " bytes...\n";
+    void* memory = std::malloc(m);
+    Schurmalloc schurm(memory, m);
+
+    cout << "malloc(10), then mallocIsolated(10) twice, with a malloc(10) in between\n";
+    void* small = schurm.malloc(10);
+    char* a = static_cast<char*>(schurm.mallocIsolated(10));
+    void* small2 = schurm.malloc(10);
+    char* b = static_cast<char*>(schurm.mallocIsolated(10));
+    assert(small && a && small2 && b);
+    for (char* ptr : {a, b})
+    {
+        // The payload has its line to itself: the header is before it, and the footer after it.
+        assert(reinterpret_cast<std::uintptr_t>(ptr) % line == 0);
+        assert(schurm.getHeader(ptr)->size >= line);
+        assert(reinterpret_cast<char*>(schurm.getFooter(schurm.getHeader(ptr))) >= ptr + line);
+    }
+    assert(b >= a + line);
+
+    cout << "free everything, which coalesces the split-off fronts again\n";
+    schurm.free(a);
+    schurm.free(small2);
+    schurm.free(b);
+    schurm.free(small);
+    schurm.verifyMemory(vector<TB> {TB(true, m-meta)},
+                        vector<size_t> {m-meta});
+
+    cout << "With the wilderness policy, mallocIsolated can come from the top chunk\n";
+    {
+        void* wildMemory = std::malloc(m);
+        BasicSchurmalloc<WildernessPolicies> wild(wildMemory, m);
+        char* c = static_cast<char*>(wild.mallocIsolated(100));
+        assert(c);
+        assert(reinterpret_cast<std::uintptr_t>(c) % line == 0);
+        assert(wild.getFreeSpace().blocks <= 2);
+        void* d = wild.malloc(10);
+        assert(d);
+        wild.free(c);
+        wild.free(d);
+        assert(wild.getFreeSpace().blocks == 1);
+        std::free(wildMemory);
+    }
+
+    cout << "A coloured slot pool keeps 64-byte slots on their own lines\n";
+    {
+        SlotPool pool(schurm, line, 4, 3);
+        vector<void*> slots(12);
+        assert(pool.mallocBulk(slots.data(), 12) == 12);
+        for (void* slot : slots)
+        {
+            assert(reinterpret_cast<std::uintptr_t>(slot) % line == 0);
+        }
+    }
+    schurm.verifyMemory(vector<TB> {TB(true, m-meta)},
+                        vector<size_t> {m-meta});
     std::free(memory);
 }
 
-void Schurmalloc::verifyMemory(const vector<TB>& expMem, const vector<size_t>& expFreelist)
+struct PrefaultPolicies : DefaultPolicies
+{
+    using Prefault = BackgroundPrefault<64 << 10>;
+    static constexpr bool trace = false;
+};
+
+struct ReadPrefaultPolicies : DefaultPolicies
+{
+    using Prefault = BackgroundPrefault<64 << 10, Prefaulter::Access::Read>;
+    static constexpr bool trace = false;
+};
+
+template <>
+void BasicSchurmalloc<DefaultPolicies>::testPrefault()
+{
+    size_t m = 1 << 20;
+    size_t lookahead = PrefaultPolicies::Prefault::lookahead;
+    cout << "\nTesting a heap that prefaults 64 KiB ahead, on " << m << " bytes...\n";
+    HugePageRegion region(m, HugePageRegion::Mode::None);
+    assert(region.getMemory());
+    char* memory = static_cast<char*>(region.getMemory());
+    BasicSchurmalloc<PrefaultPolicies> schurm(memory, m);
+    BackgroundPrefault<64 << 10>& prefault = schurm.getPrefault();
+
+    cout << "The first 64 KiB get populated without any allocations\n";
+    prefault.wait();
+    assert(prefault.getPopulated() == lookahead);
+
+    cout << "malloc(100000) and fill it, and the heap moves the frontier past it\n";
+    char* ptr = static_cast<char*>(schurm.malloc(100000));
+    assert(ptr);
+    std::memset(ptr, 0x5a, 100000);
+    prefault.wait();
+    assert(prefault.getPopulated() >= static_cast<size_t>(ptr + 100000 - memory) + lookahead);
+    for (size_t i = 0; i < 100000; i++)
+    {
+        assert(ptr[i] == 0x5a);
+    }
+
+    cout << "Growing it in place to the end of the heap populates the rest of the region, and no further\n";
+    assert(schurm.realloc(ptr, m - 1000) == ptr);
+    prefault.wait();
+    assert(prefault.getPopulated() == m);
+    for (size_t i = 0; i < 100000; i++)
+    {
+        assert(ptr[i] == 0x5a);
+    }
+    schurm.free(ptr);
+
+    cout << "A sub-heap's block is prefaulted by the parent, and the sub-heap works as usual\n";
+    {
+        BasicSubHeap<PrefaultPolicies> tenant(schurm, "tenant", 200000);
+        assert(tenant.isValid());
+        ptr = static_cast<char*>(tenant.malloc(1000));
+        assert(ptr);
+        assert(BasicSubHeap<PrefaultPolicies>::getOwner(ptr) == &tenant);
+        std::memset(ptr, 0x5a, 1000);
+        assert(tenant.getUsage().blocks == 1);
+        BasicSubHeap<PrefaultPolicies>::free(ptr);
+    }
+    prefault.wait();
+    assert(prefault.getPopulated() == m);
+
+    cout << "A file-backed heap prefaults for reading, so its file isn't dirtied ahead of the frontier\n";
+    const char* path = "schurmallocTest.heap";
+    std::remove(path);
+    {
+        BasicPersistentHeap<ReadPrefaultPolicies> file(path, m);
+        BasicSchurmalloc<ReadPrefaultPolicies>* heap = file.heap();
+        assert(heap);
+        heap->getPrefault().wait();
+        assert(heap->getPrefault().getPopulated() == lookahead);
+        ptr = static_cast<char*>(heap->malloc(100000));
+        assert(ptr);
+        std::strcpy(ptr, "prefaulted for reading");
+        heap->setRoot(ptr);
+        heap->getPrefault().wait();
+    }
+    {
+        BasicPersistentHeap<ReadPrefaultPolicies> file(path, 0);
+        assert(file.heap());
+        assert(std::strcmp(static_cast<char*>(file.heap()->getRoot()), "prefaulted for reading") == 0);
+    }
+    std::remove(path);
+}
+
+template <class Policies>
+void BasicSchurmalloc<Policies>::verifyMemory(const vector<TB>& expMem, const vector<size_t>& expFreelist)
 {
     // Verify memory...
     void* ptr = memory;
@@ -319,6 +1236,13 @@ void Schurmalloc::verifyMemory(const vector<TB>& expMem, const vector<size_t>& e
     }
     assert(i == expMem.size());
 
+    // The top chunk (with the wilderness policy) is the last block, if it's free
+    if (top)
+    {
+        assert(isLastBlock(getFooter(top)));
+        assert(top->free);
+    }
+
     // Verify free list...
     Header* f = freeList;
     i = 0;
@@ -0,0 +1,419 @@
+#pragma once
+#include "schurmalloc.h"
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Hands out fixed-size slots from runs that are carved out of a Schurmalloc heap. Instead of a
+// linked free list threaded through the slots, each run has an occupancy bitmap (1 = free) that
+// lives in its own heap block, away from the slots. Finding a free slot is a scan for a nonzero
+// bitmap word (256 bits at a time with AVX2) and a count-trailing-zeros, and overrunning a slot
+// can't corrupt the pool's metadata.
+//
+// Runs start on a cache line boundary, so if slotSize is a multiple of the cache line size, every
+// slot has its cache lines to itself. Runs can also be coloured: each new run is offset by a
+// different number of cache lines, so the slots at the same index in different runs (which tend
+// to be equally hot) spread across cache sets instead of all mapping to the same ones.
+template <class Policies = DefaultPolicies>
+class BasicSlotPool
+{
+public:
+    BasicSlotPool() = delete;
+    BasicSlotPool(const BasicSlotPool&) = delete;
+    BasicSlotPool& operator=(const BasicSlotPool&) = delete;
+
+    // heap is where runs (and their bitmaps) come from. Each run holds slotsPerRun slots of
+    // slotSize bytes. With colours > 1, runs are offset by 0, 1, ..., colours - 1 cache lines in turn.
+    BasicSlotPool(BasicSchurmalloc<Policies>& heap, std::size_t slotSize, std::size_t slotsPerRun, std::size_t colours = 1);
+
+    // Returns every run to the heap, whether or not its slots have been freed.
+    ~BasicSlotPool();
+
+    // Returns a free slot, or NULL if there are none and the heap can't fit another run.
+    void* malloc();
+
+    // Fills slots with up to count free slots, taking whole bitmap words at a time where it can.
+    // Returns how many slots it got, which is less than count only if the heap ran out.
+    std::size_t mallocBulk(void** slots, std::size_t count);
+
+    void free(void* ptr);
+
+    // Whether ptr is a slot in this pool.
+    bool contains(void* ptr);
+
+    // Returns runs that have no slots in use to the heap.
+    void trim();
+
+private:
+    static const std::size_t bitsPerWord = 64;
+    // Bitmaps are padded to a whole number of 256-bit chunks, with the padding marked as in use.
+    static const std::size_t wordsPerChunk = 4;
+
+    // slots: The run's slots, slotsPerRun * slotSize bytes.
+    // bitmap: One bit per slot, 1 if the slot is free.
+    // slotsBlock, bitmapBlock: The heap blocks holding slots and bitmap (which are aligned within them).
+    // freeSlots: How many bits are set in bitmap.
+    // hint: No word before this one in bitmap has a free slot.
+    struct Run
+    {
+        char* slots;
+        std::uint64_t* bitmap;
+        void* slotsBlock;
+        void* bitmapBlock;
+        std::size_t freeSlots;
+        std::size_t hint;
+    };
+
+    BasicSchurmalloc<Policies>& heap;
+    std::size_t slotSize;
+    std::size_t slotsPerRun;
+    std::size_t bitmapWords;
+    std::size_t colours;
+    // The colour of the next run
+    std::size_t nextColour;
+
+    // Sorted by address of slots, so free can binary search for the run owning a pointer.
+    Run* runs;
+    void* runsBlock;
+    std::size_t runCount;
+    std::size_t runCapacity;
+
+    // The run we're allocating from. No run before it has a free slot, so live slots are packed
+    // into the lowest runs, and therefore into as few (huge) pages as possible, and the runs at the
+    // top are the ones that empty out for trim.
+    std::size_t current;
+
+    typename Policies::Lock lock;
+
+    // Allocates size bytes from the heap, aligned to align. block is set to what to give back to
+    // the heap's free. Returns NULL if the heap is out of room.
+    void* mallocAligned(std::size_t size, std::size_t align, void*& block);
+
+    // Makes current a run with a free slot, adding a run if none has one. Returns false if the
+    // heap is out of room.
+    bool findCurrentRun();
+
+    // Adds an empty run and makes it current.
+    bool addRun();
+
+    // Returns the index of the run whose slots contain ptr, or runCount if there isn't one.
+    std::size_t findRun(void* ptr);
+
+    // Returns the index of the first nonzero word of bitmap at or after start, or words if
+    // they're all zero. start must be a multiple of wordsPerChunk.
+    static std::size_t findFreeWord(const std::uint64_t* bitmap, std::size_t words, std::size_t start);
+};
+
+using SlotPool = BasicSlotPool<>;
+
+template <class Policies>
+BasicSlotPool<Policies>::BasicSlotPool(BasicSchurmalloc<Policies>& heap, std::size_t slotSize, std::size_t slotsPerRun, std::size_t colours)
+    : heap(heap)
+{
+    assert(slotSize > 0);
+    assert(slotsPerRun > 0);
+    assert(colours > 0);
+
+    // Runs start cache-line-aligned, so each slot is aligned to the largest power of 2 dividing
+    // slotSize (up to the cache line size), which is all an object of that size can need.
+    this->slotSize = slotSize;
+    this->slotsPerRun = slotsPerRun;
+    this->colours = colours;
+    nextColour = 0;
+
+    std::size_t wordsPerRun = (slotsPerRun + bitsPerWord - 1) / bitsPerWord;
+    bitmapWords = (wordsPerRun + wordsPerChunk - 1) / wordsPerChunk * wordsPerChunk;
+
+    runs = NULL;
+    runsBlock = NULL;
+    runCount = 0;
+    runCapacity = 0;
+    current = 0;
+}
+
+template <class Policies>
+BasicSlotPool<Policies>::~BasicSlotPool()
+{
+    for (std::size_t i = 0; i < runCount; i++)
+    {
+        heap.free(runs[i].slotsBlock);
+        heap.free(runs[i].bitmapBlock);
+    }
+    if (runsBlock)
+    {
+        heap.free(runsBlock);
+    }
+}
+
+template <class Policies>
+void* BasicSlotPool<Policies>::mallocAligned(std::size_t size, std::size_t align, void*& block)
+{
+    block = heap.malloc(size + align - 1);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(block);
+    return reinterpret_cast<void*>((address + align - 1) & ~static_cast<std::uintptr_t>(align - 1));
+}
+
+template <class Policies>
+bool BasicSlotPool<Policies>::addRun()
+{
+    if (runCount == runCapacity)
+    {
+        // Grow the run array. It's in the heap too, so it has to be moved by hand.
+        std::size_t newCapacity = runCapacity ? runCapacity * 2 : 4;
+        void* newBlock;
+        Run* newRuns = static_cast<Run*>(mallocAligned(newCapacity * sizeof(Run), alignof(Run), newBlock));
+        if (newRuns == NULL)
+        {
+            return false;
+        }
+        if (runsBlock)
+        {
+            std::memcpy(newRuns, runs, runCount * sizeof(Run));
+            heap.free(runsBlock);
+        }
+        runs = newRuns;
+        runsBlock = newBlock;
+        runCapacity = newCapacity;
+    }
+
+    Run run;
+    std::size_t offset = nextColour * Policies::cacheLine;
+    run.slots = static_cast<char*>(mallocAligned(offset + slotSize * slotsPerRun, Policies::cacheLine, run.slotsBlock));
+    if (run.slots == NULL)
+    {
+        return false;
+    }
+    run.slots += offset;
+    run.bitmap = static_cast<std::uint64_t*>(mallocAligned(bitmapWords * sizeof(std::uint64_t), 32, run.bitmapBlock));
+    if (run.bitmap == NULL)
+    {
+        heap.free(run.slotsBlock);
+        return false;
+    }
+
+    // Every slot starts out free. Bits past the last slot stay 0, so they're never handed out.
+    std::memset(run.bitmap, 0, bitmapWords * sizeof(std::uint64_t));
+    for (std::size_t i = 0; i < slotsPerRun / bitsPerWord; i++)
+    {
+        run.bitmap[i] = ~static_cast<std::uint64_t>(0);
+    }
+    if (slotsPerRun % bitsPerWord)
+    {
+        run.bitmap[slotsPerRun / bitsPerWord] = (static_cast<std::uint64_t>(1) << (slotsPerRun % bitsPerWord)) - 1;
+    }
+    run.freeSlots = slotsPerRun;
+    run.hint = 0;
+
+    // Insert the run in address order
+    std::size_t i = runCount;
+    while (i > 0 && runs[i - 1].slots > run.slots)
+    {
+        runs[i] = runs[i - 1];
+        i--;
+    }
+    runs[i] = run;
+    runCount++;
+    current = i;
+    nextColour = (nextColour + 1) % colours;
+    return true;
+}
+
+template <class Policies>
+bool BasicSlotPool<Policies>::findCurrentRun()
+{
+    if (current < runCount && runs[current].freeSlots)
+    {
+        return true;
+    }
+    for (std::size_t i = current; i < runCount; i++)
+    {
+        if (runs[i].freeSlots)
+        {
+            current = i;
+            return true;
+        }
+    }
+    return addRun();
+}
+
+template <class Policies>
+std::size_t BasicSlotPool<Policies>::findFreeWord(const std::uint64_t* bitmap, std::size_t words, std::size_t start)
+{
+    std::size_t w = start;
+#if defined(__AVX2__)
+    // Skip over full 256-bit chunks without looking at their words one at a time
+    for (; w < words; w += wordsPerChunk)
+    {
+        __m256i chunk = _mm256_load_si256(reinterpret_cast<const __m256i*>(bitmap + w));
+        if (!_mm256_testz_si256(chunk, chunk))
+        {
+            break;
+        }
+    }
+#endif
+    for (; w < words; w++)
+    {
+        if (bitmap[w])
+        {
+            return w;
+        }
+    }
+    return words;
+}
+
+template <class Policies>
+void* BasicSlotPool<Policies>::malloc()
+{
+    std::lock_guard<typename Policies::Lock> guard(lock);
+    if (!findCurrentRun())
+    {
+        return NULL;
+    }
+
+    Run& run = runs[current];
+    std::size_t w = findFreeWord(run.bitmap, bitmapWords, run.hint);
+    assert(w < bitmapWords);
+    std::size_t bit = std::countr_zero(run.bitmap[w]);
+    run.bitmap[w] &= run.bitmap[w] - 1; // Clear the lowest set bit
+    run.freeSlots--;
+    run.hint = w / wordsPerChunk * wordsPerChunk;
+    return run.slots + (w * bitsPerWord + bit) * slotSize;
+}
+
+template <class Policies>
+std::size_t BasicSlotPool<Policies>::mallocBulk(void** slots, std::size_t count)
+{
+    std::lock_guard<typename Policies::Lock> guard(lock);
+    std::size_t got = 0;
+    while (got < count && findCurrentRun())
+    {
+        Run& run = runs[current];
+        while (got < count && run.freeSlots)
+        {
+            std::size_t w = findFreeWord(run.bitmap, bitmapWords, run.hint);
+            assert(w < bitmapWords);
+            std::uint64_t word = run.bitmap[w];
+            std::size_t taken = std::popcount(word);
+            if (taken > count - got)
+            {
+                // Only take as many of the word's free slots as we still need
+                taken = count - got;
+                std::uint64_t keep = word;
+                for (std::size_t i = 0; i < taken; i++)
+                {
+                    keep &= keep - 1;
+                }
+                word ^= keep;
+                run.bitmap[w] = keep;
+            }
+            else
+            {
+                run.bitmap[w] = 0;
+            }
+
+            char* base = run.slots + w * bitsPerWord * slotSize;
+            while (word)
+            {
+                slots[got++] = base + std::countr_zero(word) * slotSize;
+                word &= word - 1;
+            }
+            run.freeSlots -= taken;
+            run.hint = w / wordsPerChunk * wordsPerChunk;
+        }
+    }
+    return got;
+}
+
+template <class Policies>
+std::size_t BasicSlotPool<Policies>::findRun(void* ptr)
+{
+    char* p = static_cast<char*>(ptr);
+    std::size_t lo = 0;
+    std::size_t hi = runCount;
+    while (lo < hi)
+    {
+        std::size_t mid = lo + (hi - lo) / 2;
+        if (p < runs[mid].slots)
+        {
+            hi = mid;
+        }
+        else if (p >= runs[mid].slots + slotSize * slotsPerRun)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            return mid;
+        }
+    }
+    return runCount;
+}
+
+template <class Policies>
+void BasicSlotPool<Policies>::free(void* ptr)
+{
+    std::lock_guard<typename Policies::Lock> guard(lock);
+    std::size_t i = findRun(ptr);
+    assert(i < runCount);
+    Run& run = runs[i];
+
+    std::size_t offset = static_cast<char*>(ptr) - run.slots;
+    std::size_t slot = offset / slotSize;
+    std::size_t w = slot / bitsPerWord;
+    std::uint64_t mask = static_cast<std::uint64_t>(1) << (slot % bitsPerWord);
+    if constexpr (Policies::checks)
+    {
+        assert(offset % slotSize == 0);
+        assert(!(run.bitmap[w] & mask)); // Double free
+    }
+
+    run.bitmap[w] |= mask;
+    run.freeSlots++;
+    if (w / wordsPerChunk * wordsPerChunk < run.hint)
+    {
+        run.hint = w / wordsPerChunk * wordsPerChunk;
+    }
+    if (i < current)
+    {
+        current = i;
+    }
+}
+
+template <class Policies>
+bool BasicSlotPool<Policies>::contains(void* ptr)
+{
+    std::lock_guard<typename Policies::Lock> guard(lock);
+    return findRun(ptr) < runCount;
+}
+
+template <class Policies>
+void BasicSlotPool<Policies>::trim()
+{
+    std::lock_guard<typename Policies::Lock> guard(lock);
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < runCount; i++)
+    {
+        if (runs[i].freeSlots == slotsPerRun)
+        {
+            heap.free(runs[i].slotsBlock);
+            heap.free(runs[i].bitmapBlock);
+        }
+        else
+        {
+            runs[kept++] = runs[i];
+        }
+    }
+    runCount = kept;
+    current = 0;
+}
@@ -0,0 +1,206 @@
+#pragma once
+#include "schurmalloc.h"
+#include <cassert>
+#include <cstddef>
+#include <optional>
+#include <string>
+
+// A named heap with a byte quota, carved out of a parent Schurmalloc as one block. The sub-heap
+// is a Schurmalloc of its own inside that block, so a tenant's burst can only exhaust its own
+// quota, and destroy hands the whole block back to the parent with a single free, no matter how
+// many objects are still live in it.
+//
+// Each block starts with a tag pointing at the sub-heap that owns it, so free finds the owner
+// from the pointer alone, without any lookup shared between sub-heaps.
+template <class Policies = DefaultPolicies>
+class BasicSubHeap
+{
+public:
+    BasicSubHeap() = delete;
+    BasicSubHeap(const BasicSubHeap&) = delete;
+    BasicSubHeap& operator=(const BasicSubHeap&) = delete;
+
+    // Carves quota bytes (including the sub-heap's own metadata) out of parent. A quota too small
+    // for even a 1-byte block leaves the sub-heap invalid.
+    BasicSubHeap(BasicSchurmalloc<Policies>& parent, const char* name, std::size_t quota);
+
+    // Destroys the sub-heap if it hasn't been already.
+    ~BasicSubHeap();
+
+    // Whether the quota could be carved out of the parent. If not, malloc always returns NULL.
+    bool isValid() const;
+    const std::string& getName() const;
+
+    // Returns NULL if the sub-heap's quota can't fit size more bytes.
+    void* malloc(std::size_t size);
+    void* realloc(void* ptr, std::size_t newSize);
+
+    // Frees a block from any sub-heap (of these policies), which is found from ptr's tag.
+    static void free(void* ptr);
+
+    // The sub-heap that ptr was allocated from
+    static BasicSubHeap* getOwner(void* ptr);
+
+    // quota: Bytes carved out of the parent.
+    // bytesInUse, peakBytesInUse: Bytes in live blocks, including their tags.
+    // blocks: How many blocks are live.
+    struct Usage
+    {
+        std::size_t quota;
+        std::size_t bytesInUse;
+        std::size_t peakBytesInUse;
+        std::size_t blocks;
+    };
+    Usage getUsage();
+
+    // Returns the whole sub-heap to the parent at once. Blocks that are still live are freed
+    // along with it, so don't touch them afterwards. The sub-heap can't be used after this.
+    void destroy();
+
+private:
+    // The sub-heap counts its blocks and bytes, and otherwise behaves like its parent. Its block
+    // is already covered by the parent's prefaulting, so it doesn't start its own. It doesn't
+    // profile either, since nothing would ever see that profile.
+    struct Accounted : Policies
+    {
+        using Stats = CountingStats;
+        using Prefault = NoPrefault;
+        using Profiler = NoProfiler;
+    };
+
+    // The tag before each payload. Padded so payloads stay aligned.
+    static constexpr std::size_t alignment = Policies::alignment;
+    static constexpr std::size_t tagSpace = (sizeof(BasicSubHeap*) + alignment - 1) & ~(alignment - 1);
+
+    BasicSchurmalloc<Policies>& parent;
+    std::string name;
+    std::size_t quota;
+
+    // The block of the parent's that the sub-heap lives in. NULL once destroyed.
+    void* memory;
+    std::optional<BasicSchurmalloc<Accounted>> heap;
+
+    static BasicSubHeap*& getTag(void* payload);
+};
+
+using SubHeap = BasicSubHeap<>;
+
+template <class Policies>
+BasicSubHeap<Policies>::BasicSubHeap(BasicSchurmalloc<Policies>& parent, const char* name, std::size_t quota)
+    : parent(parent), name(name), quota(quota)
+{
+    if (quota < BasicSchurmalloc<Accounted>::getMinSize() + tagSpace)
+    {
+        memory = NULL;
+        return;
+    }
+    memory = parent.malloc(quota);
+    if (memory)
+    {
+        heap.emplace(memory, quota);
+    }
+}
+
+template <class Policies>
+BasicSubHeap<Policies>::~BasicSubHeap()
+{
+    destroy();
+}
+
+template <class Policies>
+bool BasicSubHeap<Policies>::isValid() const
+{
+    return heap.has_value();
+}
+
+template <class Policies>
+const std::string& BasicSubHeap<Policies>::getName() const
+{
+    return name;
+}
+
+template <class Policies>
+BasicSubHeap<Policies>*& BasicSubHeap<Policies>::getTag(void* payload)
+{
+    return *reinterpret_cast<BasicSubHeap**>(static_cast<char*>(payload) - tagSpace);
+}
+
+template <class Policies>
+void* BasicSubHeap<Policies>::malloc(std::size_t size)
+{
+    if (!heap || size == 0)
+    {
+        return NULL;
+    }
+    char* block = static_cast<char*>(heap->malloc(tagSpace + size));
+    if (block == NULL)
+    {
+        return NULL;
+    }
+    getTag(block + tagSpace) = this;
+    return block + tagSpace;
+}
+
+template <class Policies>
+void* BasicSubHeap<Policies>::realloc(void* ptr, std::size_t newSize)
+{
+    if (ptr == NULL)
+    {
+        return malloc(newSize);
+    }
+    assert(getOwner(ptr) == this);
+    if (newSize == 0)
+    {
+        free(ptr);
+        return NULL;
+    }
+    char* block = static_cast<char*>(heap->realloc(static_cast<char*>(ptr) - tagSpace, tagSpace + newSize));
+    if (block == NULL)
+    {
+        return NULL;
+    }
+    return block + tagSpace;
+}
+
+template <class Policies>
+void BasicSubHeap<Policies>::free(void* ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+    BasicSubHeap* owner = getOwner(ptr);
+    assert(owner->heap);
+    owner->heap->free(static_cast<char*>(ptr) - tagSpace);
+}
+
+template <class Policies>
+BasicSubHeap<Policies>* BasicSubHeap<Policies>::getOwner(void* ptr)
+{
+    return getTag(ptr);
+}
+
+template <class Policies>
+typename BasicSubHeap<Policies>::Usage BasicSubHeap<Policies>::getUsage()
+{
+    Usage usage = {quota, 0, 0, 0};
+    if (heap)
+    {
+        CountingStats stats = heap->copyStats();
+        usage.bytesInUse = stats.bytesInUse;
+        usage.peakBytesInUse = stats.peakBytesInUse;
+        usage.blocks = stats.mallocs - stats.frees;
+    }
+    return usage;
+}
+
+template <class Policies>
+void BasicSubHeap<Policies>::destroy()
+{
+    if (memory)
+    {
+        heap.reset();
+        parent.free(memory);
+        memory = NULL;
+    }
+}